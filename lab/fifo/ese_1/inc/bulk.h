@@ -0,0 +1,83 @@
+#ifndef _BULK_HH
+#define _BULK_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// A bulk client sends many pairs of integers [a,b], and gets back a bitmap:
+// bit i (byte i / 8, least significant bit first) is 1 if a < b for the
+// i-th pair, 0 if a >= b.
+// The pairs are sent in messages made of a BulkHeader and at most BULK_CHUNK
+// pairs: a message fits in PIPE_BUF bytes, so it is written atomically and
+// the messages of different clients never mix in the server FIFO.
+// The server answers each message with a BulkResult followed by its part of
+// the bitmap, written in the FIFO BULK_FIFO_BASE<pid of the client>
+
+// the first integer of a bulk message: a pair [BULK_MAGIC, b] can not be
+// sent by a client asking for a single comparison
+#define BULK_MAGIC 0x4B4C5542
+
+// the prefix of the FIFOs of the bulk clients (the pid follows)
+#define BULK_FIFO_BASE "/tmp/fifo_bulk."
+
+// max pairs of a message (a multiple of 32)
+#define BULK_CHUNK 480
+
+// max bulk clients served at the same time by the server
+#define BULK_CLIENTS 16
+
+struct BulkHeader {     /* bulk message (client --> server)        */
+    int magic;          /* BULK_MAGIC                              */
+    pid_t cPid;         /* PID of the client                       */
+    uint32_t first;     /* index of the first pair of the message  */
+    uint32_t count;     /* pairs following the header              */
+    uint32_t total;     /* pairs sent by the client                */
+};
+
+struct BulkResult {     /* result of a message (server --> client) */
+    uint32_t first;     /* BulkHeader.first                        */
+    uint32_t count;     /* BulkHeader.count: (count + 7) / 8 bytes follow */
+};
+
+// a bulk client served by the server
+struct BulkClient {
+    pid_t cPid;
+    int fd;                     /* write end of its FIFO, -1: not open   */
+    int dropped;                /* 1: its messages are ignored up to the last one */
+    unsigned long pairs, lower; /* pairs compared, and how many a < b    */
+    uint64_t compareNs;         /* time spent comparing                  */
+};
+
+// The compare_pairs method sets the bitmap ((n + 7) / 8 bytes) of the
+// n pairs [pairs[2i], pairs[2i + 1]], using AVX2 or SSE2 if the CPU has it
+void compare_pairs(const int *pairs, size_t n, uint8_t *bitmap);
+
+// The compare_kernel method returns the name of the kernel used by compare_pairs
+const char *compare_kernel(void);
+
+// The bulk_serve method reads the rest of a bulk message from serverFIFO
+// (v holds its first two integers, already read), compares its pairs and
+// writes the result in the FIFO of the client. The FIFO stays open in an
+// entry of clients (BULK_CLIENTS entries) until the last message of the
+// client: if all the entries are taken, the message is refused.
+// It never waits for the client: a client not reading its FIFO is dropped,
+// and its messages are ignored up to the last one.
+// It returns 1 after the last message of the client, 0 if more messages
+// are expected, -1 if the message is cut or refused, or the client is
+// gone or dropped.
+// It terminates the calling process if a system call fails
+int bulk_serve(int serverFIFO, const int v[2], struct BulkClient *clients);
+
+// The bulk_close method closes the FIFO of client, if open, freeing its entry
+void bulk_close(struct BulkClient *client);
+
+// The bulk_compare method sends the n pairs through the server FIFO
+// (already open in write-only mode) and collects the bitmap of the results,
+// receiving them in the FIFO of the calling process while it sends.
+// It returns 0, or -1 if the server dropped some results (the client did
+// not read them in time, or the server was serving too many clients).
+// It terminates the calling process if a system call fails
+int bulk_compare(int serverFIFO, const int *pairs, size_t n, uint8_t *bitmap);
+
+#endif
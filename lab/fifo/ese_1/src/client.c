@@ -1,15 +1,55 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include "errExit.h"
+#include "bulk.h"
+
+// send n random pairs in bulk, check the bitmap and report the throughput
+static void bulk (int serverFIFO, size_t n) {
+    int *pairs = malloc(n * 2 * sizeof(int));
+    uint8_t *bitmap = malloc((n + 7) / 8);
+    if (pairs == NULL || bitmap == NULL)
+        errExit("<Client> malloc failed");
+    srand(getpid());
+    for (size_t i = 0; i < 2 * n; ++i)
+        pairs[i] = rand() - RAND_MAX / 2;
+
+    printf("<Client> sending %zu pairs\n", n);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (bulk_compare(serverFIFO, pairs, n, bitmap) == -1) {
+        printf("<Client> the server dropped some results\n");
+        exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    size_t lower = 0, wrong = 0;
+    for (size_t i = 0; i < n; ++i) {
+        int bit = (bitmap[i / 8] >> (i % 8)) & 1;
+        lower += bit;
+        wrong += bit != (pairs[2 * i] < pairs[2 * i + 1]);
+    }
+    printf("<Client> %zu pairs compared in %.3f s (%.1f Mpairs/s): %zu lower than, %zu wrong results\n",
+           n, elapsed, (elapsed > 0)? n / elapsed / 1e6 : 0, lower, wrong);
+    free(pairs);
+    free(bitmap);
+}
 
 int main (int argc, char *argv[]) {
     // Checkg command line input arguments
-    // The program only wants a FIFO pathname
-    if (argc != 2) {
-        printf("Usage: %s fifo_pathname\n", argv[0]);
+    // The program wants a FIFO pathname, and the pairs of a bulk comparison
+    if (argc != 2 && argc != 3) {
+        printf("Usage: %s fifo_pathname [pairs]\n", argv[0]);
+        return 0;
+    }
+    long nPairs = (argc == 3)? atol(argv[2]) : 0;
+    if (argc == 3 && (nPairs <= 0 || nPairs > UINT32_MAX)) {
+        printf("<Client> the pairs must be between 1 and %u\n", UINT32_MAX);
         return 0;
     }
 
@@ -22,6 +62,13 @@ int main (int argc, char *argv[]) {
     if(serverFIFO == -1)
         errExit("<Client> FIFO Open Failed");
 
+    if (nPairs > 0) {
+        bulk(serverFIFO, nPairs);
+        if(close(serverFIFO) == -1)
+            errExit("<Client> Error FIFO Closed");
+        return 0;
+    }
+
     int v [] = {0, 0};
     printf("<Client> Give me two numbers: ");
     scanf("%d %d", &v[0], &v[1]);
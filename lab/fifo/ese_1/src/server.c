@@ -3,7 +3,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <signal.h>
 #include "errExit.h"
+#include "bulk.h"
 
 // the FIFO pathname
 char *path2ServerFIFO;
@@ -41,12 +43,30 @@ int main (int argc, char *argv[]) {
     int v [] = {0, 0};
     printf("<Server> waiting for vector [a,b]...\n");
     // Reading 2 integers from the FIFO.
-    int rB = read(serverFIFO, v, sizeof(v));
+    ssize_t rB = read(serverFIFO, v, sizeof(v));
 
     // Checking the number of bytes from the FIFO
     if (rB == -1)
         printf("<Server> it looks like the FIFO is broken");
-    if (rB < sizeof(v))
+    if (rB == (ssize_t) sizeof(v) && v[0] == BULK_MAGIC) {
+        // a bulk client: its pairs come in several messages, each one
+        // starting with BULK_MAGIC
+        struct BulkClient clients[BULK_CLIENTS];
+        for (int i = 0; i < BULK_CLIENTS; ++i) {
+            clients[i].fd = -1;
+            clients[i].dropped = 0;
+        }
+        signal(SIGPIPE, SIG_IGN);
+        while (bulk_serve(serverFIFO, v, clients) == 0) {
+            rB = read(serverFIFO, v, sizeof(v));
+            if (rB < (ssize_t) sizeof(v) || v[0] != BULK_MAGIC) {
+                printf("<Server> it looks like the bulk client did not send all its pairs\n");
+                break;
+            }
+        }
+        for (int i = 0; i < BULK_CLIENTS; ++i)
+            bulk_close(&clients[i]);
+    } else if (rB < (ssize_t) sizeof(v))
         printf("<Server> it looks like I did not receive 2 numbers");
     else
         printf("<Server> %d is %s %d\n", v[0],
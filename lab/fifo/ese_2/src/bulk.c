@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "bulk.h"
+#include "errExit.h"
+
+static uint64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// read size bytes, even if they come with several reads.
+// It returns 0, or -1 if the FIFO is closed first, or if it is
+// non-blocking and the bytes are not there
+static int read_all (int fd, void *buffer, size_t size) {
+    for (size_t done = 0; done < size; ) {
+        ssize_t bR = read(fd, (char *) buffer + done, size - done);
+        if (bR == -1 && errno == EAGAIN)
+            return -1;
+        if (bR == -1 && errno != EINTR)
+            errExit("read failed");
+        if (bR == 0)
+            return -1;
+        if (bR > 0)
+            done += bR;
+    }
+    return 0;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 8 pairs each step: the a and the b of the pairs are split with a
+// shuffle, compared at once, and the 8 results make a byte of the bitmap.
+// It returns the pairs compared (a multiple of 8)
+__attribute__((target("avx2")))
+static size_t compare_avx2 (const int *pairs, size_t n, uint8_t *bitmap) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 lo = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *) (pairs + 2 * i)));
+        __m256 hi = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *) (pairs + 2 * i + 8)));
+        // a0 a1 a4 a5 | a2 a3 a6 a7, and the b in the same order
+        __m256i a = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m256i b = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256i lower = _mm256_permute4x64_epi64(_mm256_cmpgt_epi32(b, a), _MM_SHUFFLE(3, 1, 2, 0));
+        bitmap[i / 8] = (uint8_t) _mm256_movemask_ps(_mm256_castsi256_ps(lower));
+    }
+    return i;
+}
+
+// the same with 4 pairs each step
+__attribute__((target("sse2")))
+static size_t compare_sse2 (const int *pairs, size_t n, uint8_t *bitmap) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int bits = 0;
+        for (int h = 0; h < 8; h += 4) {
+            __m128 lo = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (pairs + 2 * (i + h))));
+            __m128 hi = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (pairs + 2 * (i + h) + 4)));
+            __m128i a = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i b = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+            bits |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(a, b))) << h;
+        }
+        bitmap[i / 8] = (uint8_t) bits;
+    }
+    return i;
+}
+#endif
+
+const char *compare_kernel(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+    if (__builtin_cpu_supports("sse2"))
+        return "sse2";
+#endif
+    return "scalar";
+}
+
+void compare_pairs(const int *pairs, size_t n, uint8_t *bitmap) {
+    size_t i = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+        i = compare_avx2(pairs, n, bitmap);
+    else if (__builtin_cpu_supports("sse2"))
+        i = compare_sse2(pairs, n, bitmap);
+#endif
+    // the last pairs (all of them without SIMD) one by one
+    if (i < n)
+        memset(bitmap + i / 8, 0, (n - i + 7) / 8);
+    for (; i < n; ++i)
+        if (pairs[2 * i] < pairs[2 * i + 1])
+            bitmap[i / 8] |= 1 << (i % 8);
+}
+
+// close the FIFO of client, if open
+static void close_fifo (struct BulkClient *client) {
+    if (client->fd != -1 && close(client->fd) == -1)
+        errExit("<Server> close bulk FIFO failed");
+    client->fd = -1;
+}
+
+// an entry is taken by an open FIFO, or by a client dropped before its last message
+static int taken (const struct BulkClient *client) {
+    return client->fd != -1 || client->dropped;
+}
+
+int bulk_serve(int serverFIFO, const int v[2], struct BulkClient *clients) {
+    struct {
+        struct BulkHeader header;
+        int pairs[2 * BULK_CHUNK];
+    } message;
+    message.header.magic = v[0];
+    message.header.cPid = v[1];
+    // the message was written atomically: the rest of it is already in the FIFO
+    if (read_all(serverFIFO, &message.header.first, sizeof(struct BulkHeader) - 2 * sizeof(int)) == -1)
+        return -1;
+    struct BulkHeader *header = &message.header;
+    if (header->count > BULK_CHUNK) {
+        printf("<Server> bulk message of %u pairs: at most %d expected\n", header->count, BULK_CHUNK);
+        return -1;
+    }
+    if (read_all(serverFIFO, message.pairs, header->count * 2 * sizeof(int)) == -1)
+        return -1;
+
+    // the entry of the client, or a free one. The entry of a client that
+    // was dropped and terminated before its last message is free again
+    struct BulkClient *client = NULL;
+    for (int i = 0; i < BULK_CLIENTS && client == NULL; ++i)
+        if (taken(&clients[i]) && clients[i].cPid == header->cPid)
+            client = &clients[i];
+    int fresh = (client == NULL);
+    for (int i = 0; i < BULK_CLIENTS && client == NULL; ++i)
+        if (!taken(&clients[i]) || (clients[i].dropped && kill(clients[i].cPid, 0) == -1 && errno == ESRCH)) {
+            client = &clients[i];
+            bulk_close(client);
+        }
+    int last = (header->first + header->count >= header->total);
+    struct BulkClient spare = {.fd = -1, .dropped = 0};
+    if (client == NULL) {
+        // closing the entry of another client would make it miss its results
+        printf("<Server> bulk client %d refused: %d bulk clients are served\n", header->cPid, BULK_CLIENTS);
+        if (!last)
+            return -1;
+        // the last message is answered anyway: the client sees that some
+        // results are missing, instead of waiting for them
+        client = &spare;
+    }
+    if (fresh) {
+        client->cPid = header->cPid;
+        client->pairs = client->lower = 0;
+        client->compareNs = 0;
+    }
+
+    // the messages of a dropped client are ignored up to its last one,
+    // which is answered for the same reason
+    if (client->dropped && !last)
+        return -1;
+
+    if (client->fd == -1) {
+        char path2ClientFIFO [32];
+        sprintf(path2ClientFIFO, "%s%d", BULK_FIFO_BASE, header->cPid);
+        // the server does not wait for a client: with O_NONBLOCK the open
+        // fails with ENXIO if nobody reads the FIFO, and the writes fail
+        // with EAGAIN instead of blocking when it is full
+        client->fd = open(path2ClientFIFO, O_WRONLY | O_NONBLOCK);
+        if (client->fd == -1) {
+            if (errno != ENXIO && errno != ENOENT)
+                errExit("<Server> open bulk FIFO failed");
+            printf("<Server> bulk client %d is gone\n", header->cPid);
+            bulk_close(client);
+            return -1;
+        }
+    }
+
+    struct {
+        struct BulkResult result;
+        uint8_t bitmap[BULK_CHUNK / 8];
+    } response;
+    uint64_t start = now_ns();
+    compare_pairs(message.pairs, header->count, response.bitmap);
+    client->compareNs += now_ns() - start;
+    response.result.first = header->first;
+    response.result.count = header->count;
+    size_t bytes = (header->count + 7) / 8;
+
+    // less than PIPE_BUF bytes: the client reads the whole result at once.
+    // A client filling its FIFO with results does not read them: it is
+    // dropped, as waiting for it would stop the other FIFOs of the server
+    if (write(client->fd, &response, sizeof(struct BulkResult) + bytes) == -1) {
+        if (errno == EAGAIN)
+            printf("<Server> bulk client %d does not read its results: dropped\n", header->cPid);
+        else if (errno == EPIPE)
+            printf("<Server> bulk client %d is gone\n", header->cPid);
+        else
+            errExit("<Server> write bulk result failed");
+        close_fifo(client);
+        client->dropped = 1;
+    } else {
+        for (size_t i = 0; i < bytes; ++i)
+            client->lower += __builtin_popcount(response.bitmap[i]);
+        client->pairs += header->count;
+    }
+
+    if (!last)
+        return client->dropped? -1 : 0;
+    printf("<Server> %lu pairs of client %d compared: %lu lower than, %lu dropped, %.0f Mpairs/s (%s)\n",
+           client->pairs, client->cPid, client->lower, header->total - client->pairs,
+           client->compareNs? client->pairs * 1e3 / client->compareNs : 0, compare_kernel());
+    int complete = (client->pairs == header->total);
+    bulk_close(client);
+    return complete? 1 : -1;
+}
+
+void bulk_close(struct BulkClient *client) {
+    close_fifo(client);
+    client->dropped = 0;
+}
+
+int bulk_compare(int serverFIFO, const int *pairs, size_t n, uint8_t *bitmap) {
+    char path2ClientFIFO [32];
+    sprintf(path2ClientFIFO, "%s%d", BULK_FIFO_BASE, getpid());
+    if (mkfifo(path2ClientFIFO, 0640) == -1)
+        errExit("<Client> bulk FIFO creation failed");
+
+    // the read end is opened without waiting for the server; the extra write
+    // end makes the FIFO look open to poll and read before the server opens it
+    int clientFIFO = open(path2ClientFIFO, O_RDONLY | O_NONBLOCK);
+    if (clientFIFO == -1)
+        errExit("<Client> bulk FIFO open failed");
+    int clientFIFO_extra = open(path2ClientFIFO, O_WRONLY);
+    if (clientFIFO_extra == -1)
+        errExit("<Client> bulk FIFO open failed");
+
+    // the client sends and receives at the same time: blocking in write
+    // while the server blocks writing a result nobody reads would never end
+    int flags = fcntl(serverFIFO, F_GETFL);
+    if (flags == -1 || fcntl(serverFIFO, F_SETFL, flags | O_NONBLOCK) == -1)
+        errExit("fcntl failed");
+
+    struct {
+        struct BulkHeader header;
+        int pairs[2 * BULK_CHUNK];
+    } message;
+    message.header.magic = BULK_MAGIC;
+    message.header.cPid = getpid();
+    message.header.total = (uint32_t) n;
+    size_t sent = 0, received = 0;
+    int missing = 0;
+    while (received < n && !missing) {
+        // once all the pairs are sent, the server may close its FIFO
+        struct pollfd fds[2] = {
+            {.fd = clientFIFO, .events = POLLIN},
+            {.fd = (sent < n)? serverFIFO : -1, .events = POLLOUT}
+        };
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            errExit("poll failed");
+        }
+
+        if (fds[1].revents & POLLOUT) {
+            size_t count = (n - sent < BULK_CHUNK)? n - sent : BULK_CHUNK;
+            message.header.first = (uint32_t) sent;
+            message.header.count = (uint32_t) count;
+            memcpy(message.pairs, pairs + 2 * sent, count * 2 * sizeof(int));
+            // at most PIPE_BUF bytes: the whole message is written, or nothing
+            if (write(serverFIFO, &message, sizeof(struct BulkHeader) + count * 2 * sizeof(int)) == -1) {
+                if (errno != EAGAIN)
+                    errExit("<Client> bulk write failed");
+            } else {
+                sent += count;
+            }
+        } else if (fds[1].revents & (POLLERR | POLLHUP)) {
+            errExit("<Client> the server closed its FIFO");
+        }
+
+        if (fds[0].revents & POLLIN) {
+            // a result is written with a single write: its bitmap follows it
+            struct BulkResult result;
+            while (read(clientFIFO, &result, sizeof(result)) == sizeof(result)) {
+                if (result.first + result.count > n || result.first % 8 != 0)
+                    errExit("<Client> unexpected bulk result");
+                if (read_all(clientFIFO, bitmap + result.first / 8, (result.count + 7) / 8) == -1)
+                    errExit("<Client> bulk result cut");
+                // the results come in order: a gap means the server dropped
+                // the client, and the missing results will never come
+                if (result.first != received) {
+                    missing = 1;
+                    break;
+                }
+                received += result.count;
+            }
+        }
+    }
+
+    if (fcntl(serverFIFO, F_SETFL, flags) == -1)
+        errExit("fcntl failed");
+    if (close(clientFIFO) == -1 || close(clientFIFO_extra) == -1)
+        errExit("<Client> close bulk FIFO failed");
+    if (unlink(path2ClientFIFO) != 0)
+        errExit("<Client> unlink bulk FIFO failed");
+    return missing? -1 : 0;
+}
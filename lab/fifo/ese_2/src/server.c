@@ -1,106 +1,232 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <getopt.h>
 #include "errExit.h"
+#include "bulk.h"
 
-// the FIFO pathname
-char *path2ServerFIFO;
-// the file descriptors for the FIFO
-int serverFIFO, serverFIFO_extra;
+// default seconds a FIFO may stay without messages before it is removed
+#define IDLE_TIMEOUT 30
 
-void quit(int);
+// max messages read from a FIFO for each epoll event, so that a busy FIFO
+// does not starve the others (epoll reports it again if more are waiting)
+#define FIFO_BATCH 64
 
-int main (int argc, char *argv[]) {
-    // Check command line input arguments
-    // The program only wants a FIFO pathname
-    if (argc != 2) {
-        printf("Usage: %s fifo_pathname\n", argv[0]);
-        return 1;
-    }
+// the epoll tag of the timerfd (the other tags are indexes of endpoints)
+#define TIMER_TAG UINT64_MAX
+
+// A FIFO served by the server
+struct Endpoint {
+    char *path;
+    int fd, fd_extra;           /* read end, and the extra write end: -1 once removed */
+    uint64_t lastNs;            /* when the last message came            */
+};
 
-    // read the FIFO's pathname
-    path2ServerFIFO = argv[1];
+// the FIFOs, and how many of them are still served
+struct Endpoint *endpoints;
+int nEndpoints, nOpen;
 
+// a single epoll instance waits for all the FIFOs and for the timerfd
+int epollFD, timerFD;
+uint64_t idleNs = IDLE_TIMEOUT * 1000000000ull;
+
+// the bulk clients
+struct BulkClient bulkClients[BULK_CLIENTS];
+
+static uint64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void open_endpoint (struct Endpoint *endpoint, uint64_t tag) {
     printf("<Server> making FIFO...\n");
     // make a FIFO with the following permissions:
     // user:  read, write
     // group: write
     // other: no permission
-    if(mkfifo(path2ServerFIFO, 0640) == -1)
+    if(mkfifo(endpoint->path, 0640) == -1)
         errExit("<Server> Create FIFO Error");
-    
-
-    printf("<Server> FIFO %s created!\n", path2ServerFIFO);
 
-    // setting a signal handler for SIGALRM signal
-    signal(SIGALRM, quit);
+    printf("<Server> FIFO %s created!\n", endpoint->path);
 
-    // set a 30 seconds alarm
-    alarm(30);
-
-    // Wait for clients in read-only mode. The open blocks the calling process
-    // until another process opens the same FIFO in write-only mode
-    printf("<Server> waiting for a client...\n");
-    if((serverFIFO = open(path2ServerFIFO, O_RDONLY)) == -1)
-        errExit("<Server> Open FIFO Failed"); 
+    // The read end is opened without waiting for a client: the server
+    // waits for the messages of all the FIFOs in epoll_wait
+    if((endpoint->fd = open(endpoint->path, O_RDONLY | O_NONBLOCK)) == -1)
+        errExit("<Server> Open FIFO Failed");
 
     // Open an extra file descriptor, so that the server does not see end-of-file
-    // even if all clients closed the write end of the FIFO
-    serverFIFO_extra = open(path2ServerFIFO, O_WRONLY);
-    if (serverFIFO_extra == -1)
+    // even if all clients closed the write end of the FIFO (epoll would report
+    // EPOLLHUP at each epoll_wait)
+    endpoint->fd_extra = open(endpoint->path, O_WRONLY);
+    if (endpoint->fd_extra == -1)
         errExit("<Server> open write-only failed");
 
-    int bR = -1;
-    int v [] = {0, 1};
-    do {
-        printf("<Server> waiting for vector [a,b]...\n");
-        // Read 2 integers from the FIFO.
-        bR = read(serverFIFO, v, sizeof(v));
+    struct epoll_event event = {.events = EPOLLIN, .data.u64 = tag};
+    if (epoll_ctl(epollFD, EPOLL_CTL_ADD, endpoint->fd, &event) == -1)
+        errExit("<Server> epoll_ctl failed");
+    endpoint->lastNs = now_ns();
+    nOpen++;
+}
+
+// close the file descriptors for the FIFO, and remove the FIFO from the file system
+static void close_endpoint (struct Endpoint *endpoint) {
+    // Closing the FIFO (this removes it from the epoll instance too)
+    if(close(endpoint->fd) == -1)
+        errExit("<Server> Close FIFO Error");
 
-        // remove the alarm
-        alarm(0);
+    if (close(endpoint->fd_extra) == -1)
+        errExit("<Server> Close FIFO failed");
+    endpoint->fd = endpoint->fd_extra = -1;
+
+    // Removing the FIFO
+    unlink(endpoint->path);
+    printf("<Server> FIFO %s removed\n", endpoint->path);
+    nOpen--;
+}
+
+// read the messages waiting in the FIFO of endpoint
+static void serve_endpoint (struct Endpoint *endpoint, uint64_t now) {
+    endpoint->lastNs = now;
+    for (int m = 0; m < FIFO_BATCH; ++m) {
+        int v [] = {0, 1};
+        // Read 2 integers from the FIFO.
+        ssize_t bR = read(endpoint->fd, v, sizeof(v));
+        if (bR == -1 && errno == EAGAIN)
+            return;
 
         // Check the number of bytes read from the FIFO
-	    if (bR == -1)
-            printf("<Server> it looks like the FIFO is broken");
-        if (bR < sizeof(v))
-            printf("<Server> it looks like I did not receive 2 numbers");
+        if (bR == -1) {
+            printf("<Server> it looks like the FIFO %s is broken\n", endpoint->path);
+            close_endpoint(endpoint);
+            return;
+        }
+        if (bR == (ssize_t) sizeof(v) && v[0] == BULK_MAGIC)
+            // a bulk message: the rest of it follows in the FIFO
+            bulk_serve(endpoint->fd, v, bulkClients);
+        else if (bR < (ssize_t) sizeof(v))
+            printf("<Server> it looks like I did not receive 2 numbers\n");
         else
             printf("<Server> %d is %s %d\n", v[0],
             (v[0] < v[1])? "lower than" : "greater/equals to", v[1]);
 
-        // reset the alarm
-        alarm(30);
-    // iter. until the two integers are different, and the FIFO works
-    } while (v[0] != v[1] && bR != -1);
-
-    quit(0);
+        // two equal integers close the FIFO
+        if (bR == (ssize_t) sizeof(v) && v[0] == v[1]) {
+            close_endpoint(endpoint);
+            return;
+        }
+    }
 }
 
+// remove the FIFOs idle for idleNs, and set the timerfd to expire at the
+// next deadline. A message only moves the deadline of its FIFO later: the
+// timerfd is not set again for each message, it expires a bit early instead
+static void check_idle (uint64_t now) {
+    uint64_t next = UINT64_MAX;
+    for (int i = 0; i < nEndpoints; ++i) {
+        struct Endpoint *endpoint = &endpoints[i];
+        if (endpoint->fd == -1)
+            continue;
+        if (now - endpoint->lastNs >= idleNs) {
+            printf("<Server> Time expired for %s!\n", endpoint->path);
+            close_endpoint(endpoint);
+        } else if (endpoint->lastNs + idleNs < next) {
+            next = endpoint->lastNs + idleNs;
+        }
+    }
+    if (next == UINT64_MAX)
+        return;
+
+    struct itimerspec deadline = {
+        .it_value = {.tv_sec = next / 1000000000ull, .tv_nsec = next % 1000000000ull}
+    };
+    if (timerfd_settime(timerFD, TFD_TIMER_ABSTIME, &deadline, NULL) == -1)
+        errExit("<Server> timerfd_settime failed");
+}
 
-// the quit function closes the file descriptors for the FIFO,
-// and removes the FIFO from the file system
-void quit(int sig) {
-    // the quit function is used as signal handler for the ALARM signal too.
-    if (sig == SIGALRM)
-        printf("<Server> Time expired!\n");
-
-    // Closing the FIFO
-    if(close(serverFIFO) == -1)
-        errExit("<Server> Close FIFO Error");
-
-    if (serverFIFO_extra != 0 && close(serverFIFO_extra) == -1)
-        errExit("<Server> Close FIFO failed");
+int main (int argc, char *argv[]) {
+    // Check command line input arguments
+    // The program wants one or more FIFO pathnames
+    int opt;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+            case 't': idleNs = strtoull(optarg, NULL, 10) * 1000000000ull; break;
+            default: optind = argc + 1;
+        }
+    }
+    if (optind >= argc || idleNs == 0) {
+        printf("Usage: %s [-t idleSeconds] fifo_pathname [fifo_pathname ...]\n", argv[0]);
+        printf("  -t  remove a FIFO after so many seconds without messages (default %d)\n", IDLE_TIMEOUT);
+        return 1;
+    }
 
-    // Removing the FIFO
-    unlink(path2ServerFIFO);
+    // read the FIFOs' pathnames
+    nEndpoints = argc - optind;
+    endpoints = calloc(nEndpoints, sizeof(struct Endpoint));
+    if (endpoints == NULL)
+        errExit("<Server> calloc failed");
+
+    // a bulk client closing its FIFO must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    for (int i = 0; i < BULK_CLIENTS; ++i)
+        bulkClients[i].fd = -1;
+
+    epollFD = epoll_create1(EPOLL_CLOEXEC);
+    timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epollFD == -1 || timerFD == -1)
+        errExit("<Server> epoll_create1/timerfd_create failed");
+    struct epoll_event event = {.events = EPOLLIN, .data.u64 = TIMER_TAG};
+    if (epoll_ctl(epollFD, EPOLL_CTL_ADD, timerFD, &event) == -1)
+        errExit("<Server> epoll_ctl failed");
+
+    for (int i = 0; i < nEndpoints; ++i) {
+        endpoints[i].path = argv[optind + i];
+        open_endpoint(&endpoints[i], (uint64_t) i);
+    }
+    check_idle(now_ns());
+
+    printf("<Server> waiting for vectors [a,b] on %d FIFOs...\n", nEndpoints);
+    // iter. until all the FIFOs are removed: a FIFO is removed when two
+    // equal integers come, when it is broken, or when it is idle for too long
+    struct epoll_event events[FIFO_BATCH];
+    while (nOpen > 0) {
+        int nEvents = epoll_wait(epollFD, events, FIFO_BATCH, -1);
+        if (nEvents == -1) {
+            if (errno == EINTR)
+                continue;
+            errExit("<Server> epoll_wait failed");
+        }
+
+        uint64_t now = now_ns();
+        for (int i = 0; i < nEvents; ++i) {
+            if (events[i].data.u64 == TIMER_TAG) {
+                uint64_t expirations;
+                if (read(timerFD, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+                    errExit("<Server> read timerfd failed");
+                check_idle(now);
+            } else {
+                struct Endpoint *endpoint = &endpoints[events[i].data.u64];
+                // the FIFO may be removed by a former event of this epoll_wait
+                if (endpoint->fd != -1)
+                    serve_endpoint(endpoint, now);
+            }
+        }
+    }
 
-    if(sig == 0) printf("Exiting");
-    fflush(stdout);
-    // terminating the process
-    _exit(0);
+    for (int i = 0; i < BULK_CLIENTS; ++i)
+        bulk_close(&bulkClients[i]);
+    if (close(timerFD) == -1 || close(epollFD) == -1)
+        errExit("<Server> close failed");
+    free(endpoints);
 
+    printf("Exiting\n");
+    return 0;
 }
@@ -0,0 +1,71 @@
+#ifndef _FDCACHE_HH
+#define _FDCACHE_HH
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "request_response.h"
+
+// default number of client FIFOs kept open by each worker
+#define FD_CACHE_SIZE 128
+
+// max Responses waiting to be written to a client FIFO: when they are
+// more, the new Responses of the client are lost
+#define CLIENT_PENDING 64
+
+// An FdEntry is a client with its FIFO, open or not yet open, and the
+// Responses not written yet. The entries are linked in LRU order
+// (prev/next) and in the chains of the hash table (chain)
+struct FdEntry {
+    pid_t cPid;                 /* PID of the client                     */
+    int slot;                   /* its FIFO in the pool, -1: its own FIFO */
+    int fd;                     /* write end of its FIFO, -1: not open   */
+    int prev, next;             /* more/less recently used entry, or -1  */
+    int chain;                  /* next entry of the same bucket, or -1  */
+    struct Response pending[CLIENT_PENDING];
+    int head, count;            /* the Responses not written yet         */
+    uint64_t since;             /* ns: when the client last took Responses */
+    uint64_t retryAt;           /* ns: next open of a FIFO without reader */
+    uint64_t backoff;           /* ns between two opens                  */
+};
+
+// An FdCache keeps open the FIFOs of the last clients, so that a client
+// sending many requests costs a write for each response instead of an
+// open, a write and a close. When it is full, the least recently used
+// FIFO is closed, and its pending Responses are discarded
+struct FdCache {
+    struct FdEntry *entries;
+    int capacity, used;
+    int *buckets;               /* first entry of each chain, or -1      */
+    int nBuckets;               /* a power of two                        */
+    int head, tail;             /* most and least recently used entries  */
+    unsigned long hits, misses, evictions;
+    unsigned long discarded;    /* pending Responses of removed entries  */
+};
+
+// The fdcache_init method prepares an empty cache of capacity entries.
+// It terminates the calling process if the memory can not be allocated
+void fdcache_init(struct FdCache *cache, int capacity);
+
+// The fdcache_get method returns the entry of cPid, and makes it the most
+// recently used one. It returns NULL if cPid is not cached
+struct FdEntry *fdcache_get(struct FdCache *cache, pid_t cPid);
+
+// The fdcache_find method returns the entry of cPid, without changing
+// the LRU order. It returns NULL if cPid is not cached
+struct FdEntry *fdcache_find(struct FdCache *cache, pid_t cPid);
+
+// The fdcache_put method adds an entry for cPid (not cached yet) using the
+// FIFO slot of the pool, or its own FIFO if slot is -1, with the FIFO not
+// open and no pending Response. If the cache is full, the least
+// recently used entry is removed first.
+// The returned pointer is valid until the next put or drop
+struct FdEntry *fdcache_put(struct FdCache *cache, pid_t cPid, int slot);
+
+// The fdcache_drop method closes the FIFO of cPid and removes its entry, if any
+void fdcache_drop(struct FdCache *cache, pid_t cPid);
+
+// The fdcache_free method closes all the cached FIFOs
+void fdcache_free(struct FdCache *cache);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef _FIFOPOOL_HH
+#define _FIFOPOOL_HH
+
+#include <sys/types.h>
+
+#include "request_response.h"
+
+// the key of the shared memory segment with the lease table
+#define FIFO_POOL_KEY 0x46494650
+
+// default FIFOs of the pool
+#define FIFO_POOL_SIZE 64
+
+// A FifoPool is a set of client FIFOs made once by the server, in
+// POOL_FIFO_BASE<slot>, and a lease table in shared memory.
+// A client leases a slot instead of making and removing its own FIFO,
+// and names the slot in its Requests. The lease of a client that died
+// without returning it is taken back by the next client finding the
+// pool full
+struct FifoPool {
+    int nSlots;
+    pid_t holders[];            /* the client leasing each slot, 0: free */
+};
+
+// The fifopool_create method makes the lease table (all slots free) and
+// the nSlots FIFOs of the pool. It stores the shmid of the table in shmid.
+// It returns the attached table, otherwise it terminates the calling process
+struct FifoPool *fifopool_create(int nSlots, int *shmid);
+
+// The fifopool_remove method removes the FIFOs of the pool and the
+// lease table. If it does not succeed, it terminates the calling process
+void fifopool_remove(struct FifoPool *pool, int shmid);
+
+// The fifopool_attach method attaches the lease table made by the server.
+// It returns NULL if there is no pool
+struct FifoPool *fifopool_attach(void);
+
+// The fifopool_lease method leases a free slot to cPid, copying the path
+// of its FIFO in path (32 bytes at least). If no slot is free, it takes
+// back the slot of a client that is no longer running.
+// It returns the slot, -1 if all the slots are leased by running clients
+int fifopool_lease(struct FifoPool *pool, pid_t cPid, char *path);
+
+// The fifopool_release method returns the slot leased by cPid
+void fifopool_release(struct FifoPool *pool, int slot, pid_t cPid);
+
+// The fifopool_detach method detaches the lease table.
+// If it does not succeed, it terminates the calling process
+void fifopool_detach(struct FifoPool *pool);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _HISTOGRAM_HH
+#define _HISTOGRAM_HH
+
+#include <stdio.h>
+#include <stdint.h>
+
+// number of bits of each sub-bucket: a recorded value is approximated with a
+// relative error lower than 1 / 2^(HIST_SUB_BITS - 1) (about 1.5%)
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+
+// number of power-of-two magnitudes: values up to 2^(HIST_MAGNITUDES + HIST_SUB_BITS - 1) ns
+#define HIST_MAGNITUDES 40
+
+// A Histogram records latencies (in nanoseconds) in log-linear buckets,
+// as an HDR histogram: each power-of-two range is split in HIST_SUB_COUNT / 2
+// linear sub-buckets, so the precision is the same for small and large values
+struct Histogram {
+    uint64_t counts[HIST_MAGNITUDES][HIST_SUB_COUNT];
+    uint64_t total;     /* number of recorded values */
+    uint64_t min;       /* exact min recorded value  */
+    uint64_t max;       /* exact max recorded value  */
+    double sum;         /* sum of recorded values    */
+};
+
+// The hist_init method clears all the buckets of the histogram
+void hist_init(struct Histogram *hist);
+
+// The hist_record method records a value (in nanoseconds)
+void hist_record(struct Histogram *hist, uint64_t value);
+
+// The hist_merge method adds the values recorded in from to hist
+void hist_merge(struct Histogram *hist, const struct Histogram *from);
+
+// The hist_percentile method returns the value below which the given
+// percentage (0-100) of the recorded values falls
+uint64_t hist_percentile(const struct Histogram *hist, double percentile);
+
+// The hist_print method prints min, mean, p50, p90, p99, p99.9 and max on out
+void hist_print(const struct Histogram *hist, FILE *out);
+
+// The hist_csv method writes the non-empty buckets on out, as CSV lines
+// "latency_ns,count,cumulative" (cumulative is the fraction of values <= latency_ns)
+void hist_csv(const struct Histogram *hist, FILE *out);
+
+#endif
@@ -1,15 +1,36 @@
 #ifndef _REQUEST_RESPONSE_HH
 #define _REQUEST_RESPONSE_HH
 
+#include <stdint.h>
 #include <sys/types.h>
 
+// the well-known FIFO of the server, and the prefix of the client FIFOs
+// (the pid of the client follows)
+#define SERVER_FIFO "/tmp/fifo_server"
+#define CLIENT_FIFO_BASE "/tmp/fifo_client."
+
+// the prefix of the FIFOs of the pool (the slot follows), see fifopool.h
+#define POOL_FIFO_BASE "/tmp/fifo_pool."
+
+// the code of a Request asking the server to serve the client through a
+// shared memory ring (see ring.h): its seq is the shmid of the ring.
+// The Response is 0 if the server accepted, -1 if the client must keep
+// using the FIFOs
+#define RING_CONNECT -1
+
 struct Request {   /* Request (client --> server) */
     pid_t cPid;    /* PID of client               */
     int code;      /* a random number             */
+    uint32_t seq;  /* number of the Request in the client session */
+    int slot;      /* FIFO of the pool leased by the client,
+                      -1: the FIFO of its PID   */
 };
 
 struct Response {  /* Response (server --> client) */
     int result;    /* Request.code ^ 2             */
+    uint32_t seq;  /* Request.seq                  */
+    pid_t cPid;    /* Request.cPid: a FIFO of the pool may hold
+                      Responses of a former client */
 };
 
 #endif
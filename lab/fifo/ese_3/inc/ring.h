@@ -0,0 +1,66 @@
+#ifndef _RING_HH
+#define _RING_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "request_response.h"
+
+// Requests and Responses held by the rings of a client (a power of two,
+// at least SESSION_MAX_WINDOW: a session never overflows its rings)
+#define RING_SIZE 256
+
+// max clients served through a ring by a server process
+#define RING_MAX_CLIENTS 64
+
+// times a ring is checked before sleeping on its futex
+#define RING_SPIN 200
+
+// A RingIndex tells which items of a ring are full: the producer writes
+// head, the consumer writes tail, each one in its own cache line.
+// A consumer finding the ring empty sleeps on the futex word head,
+// and the producer wakes it up only if sleepers is not 0
+struct RingIndex {
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t sleepers;
+    uint32_t tail __attribute__((aligned(64)));
+};
+
+// A Ring is a segment of shared memory made by a client: the client
+// writes its Requests in requests and reads the Responses from responses,
+// with no system call while the server is busy. The client asks the server
+// to use it with a Request through the server FIFO (see RING_CONNECT in
+// request_response.h), and the FIFOs stay the way to connect and the way
+// back if the server refuses
+struct Ring {
+    pid_t cPid;                             /* the client owning the ring    */
+    uint32_t closed;                        /* 1: the client left            */
+    struct RingIndex requestIndex;
+    struct Request requests[RING_SIZE];
+    struct RingIndex responseIndex;
+    struct Response responses[RING_SIZE];
+};
+
+// The ring_push method copies at most n items of size bytes from src to
+// the ring items/index.
+// It returns the items copied (less than n if the ring is full)
+uint32_t ring_push(struct RingIndex *index, void *items, size_t size, const void *src, uint32_t n);
+
+// The ring_pop method moves at most n items of size bytes from the ring
+// items/index to dst.
+// It returns the items moved (0 if the ring is empty)
+uint32_t ring_pop(struct RingIndex *index, const void *items, size_t size, void *dst, uint32_t n);
+
+// The ring_wake method wakes up the consumer of index, if it sleeps.
+// It returns 1 if it made a system call, otherwise 0
+int ring_wake(struct RingIndex *index);
+
+// The ring_wait method waits until the ring of index is not empty, at
+// most timeoutNs (0: no limit), spinning RING_SPIN times before sleeping
+// (if there is more than one CPU).
+// It returns 0 if the ring was filled while spinning, 1 after sleeping,
+// -1 if the time expired
+int ring_wait(struct RingIndex *index, uint64_t timeoutNs);
+
+#endif
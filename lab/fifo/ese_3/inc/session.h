@@ -0,0 +1,79 @@
+#ifndef _SESSION_HH
+#define _SESSION_HH
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "fifopool.h"
+#include "histogram.h"
+#include "request_response.h"
+#include "ring.h"
+
+// default and max Requests a session keeps outstanding.
+// SESSION_MAX_WINDOW Requests fit in PIPE_BUF bytes, so a whole window
+// is sent with a single atomic write
+#define SESSION_WINDOW 16
+#define SESSION_MAX_WINDOW 256
+
+// A Session is a client that sends many Requests over the same pair of
+// FIFOs: its FIFO is leased from the pool of the server (or made, if there
+// is no pool) and opened once, and the Requests are pipelined, up to window
+// Requests waiting for their Response.
+// The Responses are matched to the Requests by sequence number
+struct Session {
+    pid_t cPid;
+    char path2ServerFIFO[32];
+    char path2ClientFIFO[32];
+    struct FifoPool *pool;                  /* NULL: the server has no pool  */
+    int lease;                              /* slot of the pool, or -1       */
+    struct Ring *ring;                      /* NULL: Requests through FIFOs  */
+    int serverFIFO;                         /* write end of the server FIFO  */
+    int clientFIFO, clientFIFO_extra;       /* read and write end of ours    */
+    int window;
+    uint32_t next;                          /* seq of the next Request       */
+    uint32_t oldest;                        /* oldest Request not answered   */
+    int codes[SESSION_MAX_WINDOW];          /* code of each outstanding seq  */
+    uint64_t sentNs[SESSION_MAX_WINDOW];    /* when it was sent              */
+    char answered[SESSION_MAX_WINDOW];
+    char buffer[SESSION_MAX_WINDOW * sizeof(struct Response)];
+    size_t pending;                         /* bytes of a cut Response       */
+    unsigned long writes, reads, wrong;
+    uint64_t rttSumNs, rttMaxNs;            /* round trip of the Requests    */
+    struct Histogram *hist;                 /* if not NULL, each round trip  */
+};
+
+// The open_server_fifo method opens in write-only mode the server FIFO of
+// the client cPid, copying its path in path (32 bytes at least).
+// If nShards is 0 it is SERVER_FIFO, otherwise the FIFO of the shard
+// chosen by hashing cPid: if that shard is missing, the next shards are
+// tried, then SERVER_FIFO.
+// It returns the descriptor, -1 if no server FIFO exists
+int open_server_fifo(pid_t cPid, int nShards, char *path);
+
+// The session_open method leases a FIFO for the client (or makes one, if
+// the pool is missing or full) and opens both FIFOs (see open_server_fifo
+// for nShards).
+// It returns -1 if the server FIFO does not exist, otherwise 0.
+// It terminates the calling process if the client FIFO can not be made
+int session_open(struct Session *session, int window, int nShards);
+
+// The session_use_ring method asks the server, through the FIFOs, to
+// serve the session through a shared memory ring: the Requests and the
+// Responses of session_run are then copied in the ring, with a futex wake
+// only if the other side sleeps.
+// It returns 0 if the server accepted, -1 if the session keeps using the
+// FIFOs. It terminates the calling process if the ring can not be made
+int session_use_ring(struct Session *session);
+
+// The session_run method sends n Requests with random codes and waits
+// for all their Responses.
+// If rate is 0 a Request is sent as soon as the window has room (closed
+// loop), otherwise the Requests are sent rate times per second, and the
+// round trip of a Request starts at the time it should have been sent
+void session_run(struct Session *session, unsigned long n, double rate);
+
+// The session_close method closes the ring and the FIFOs, and returns the FIFO of the
+// client to the pool or removes it
+void session_close(struct Session *session);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef _WORKERS_HH
+#define _WORKERS_HH
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "fdcache.h"
+#include "request_response.h"
+
+// max Requests queued for a worker: when the queue is full the
+// server stops reading its FIFO
+#define WORKER_QUEUE 1024
+
+// default workers for each online core
+#define WORKERS_PER_CORE 1
+
+// default milliseconds a client may leave its Responses pending
+// before it is evicted
+#define CLIENT_TIMEOUT_MS 1000
+
+// min and max ns between two opens of a FIFO that nobody reads yet
+#define RETRY_MIN_NS 200000ull
+#define RETRY_MAX_NS 50000000ull
+
+// A Worker is a thread answering the Requests of the clients with
+// cPid % nWorkers == its index: the Responses to a client are sent in
+// order, and each worker owns the FdCache of its clients.
+// A worker never blocks on a client: the client FIFOs are opened and
+// written with O_NONBLOCK, and an epoll loop tells the worker when a full
+// FIFO has room again. Meanwhile the Responses wait in the entry of the
+// client (at most CLIENT_PENDING), and a client that does not take them
+// for evictMs is evicted
+struct Worker {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;                 /* Requests were taken           */
+    struct Request queue[WORKER_QUEUE];
+    int head, count;                        /* the queued Requests           */
+    int closed;                             /* 1: no more Requests           */
+    int wakeFD;                             /* eventfd: Requests were queued */
+    int epollFD;
+    struct FdCache cache;
+    int evictMs;
+    int verbose;                            /* 1: a message for each client  */
+    unsigned long served, lost, evicted;
+};
+
+// A WorkerPool dispatches the Requests read from the server FIFO
+struct WorkerPool {
+    int nWorkers;
+    struct Worker *workers;
+    size_t *order;              /* a batch of Requests sorted by worker   */
+    size_t orderCapacity;
+    size_t *first;              /* the Requests of each worker in order   */
+};
+
+// The pool_start method starts nWorkers threads, each keeping at most
+// cacheSize client FIFOs open, and evicting the clients that leave their
+// Responses pending for evictMs milliseconds.
+// It terminates the calling process if the threads can not be created
+void pool_start(struct WorkerPool *pool, int nWorkers, int cacheSize, int evictMs, int verbose);
+
+// The pool_dispatch_batch method queues n Requests for the workers of their
+// clients: the queue of each worker is locked once for all the Requests of
+// its clients, waiting if the queue is full
+void pool_dispatch_batch(struct WorkerPool *pool, const struct Request *requests, size_t n);
+
+// The pool_stop method waits for the queued Requests to be answered (or
+// their clients evicted), then stops the threads and closes the cached FIFOs
+void pool_stop(struct WorkerPool *pool);
+
+// The pool_report method prints the Requests served by each worker and
+// the hits of its FdCache, then the Requests served through rings
+void pool_report(const struct WorkerPool *pool);
+
+// The default_workers method returns WORKERS_PER_CORE workers for each online core
+int default_workers(void);
+
+#endif
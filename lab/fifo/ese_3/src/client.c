@@ -7,34 +7,105 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <getopt.h>
+
 #include "request_response.h"
+#include "fifopool.h"
+#include "session.h"
 #include "errExit.h"
 
-char *path2ServerFIFO = "/tmp/fifo_server";
-char *baseClientFIFO = "/tmp/fifo_client.";
+char path2ServerFIFO [32];
+char *baseClientFIFO = CLIENT_FIFO_BASE;
 
 int Fd2ServerFIFO, Fd2ClientFIFO;
 
 #define MAX 100
 
-int main (int argc, char *argv[]) {
+static void usage (const char *prog) {
+    printf("Usage: %s [-s shards] [-n requests] [-k window] [-m]\n", prog);
+    printf("  -s  the server is sharded in so many FIFOs: the pid of the client picks one\n");
+    printf("  -n  session mode: send so many requests over the same FIFOs\n");
+    printf("  -k  requests waiting for a response in session mode (default %d, max %d)\n",
+           SESSION_WINDOW, SESSION_MAX_WINDOW);
+    printf("  -m  in session mode, ask the server for a shared memory ring\n");
+}
 
-    // Step-1: The client makes a FIFO in /tmp
-    char path2ClientFIFO [25];
-    sprintf(path2ClientFIFO, "%s%d", baseClientFIFO, getpid());
+// send n Requests in a session, and report the round trip time
+static void run_session (unsigned long n, int window, int nShards, int useRing) {
+    struct Session session;
+    if (session_open(&session, window, nShards) == -1)
+        errExit("<Client> 2ServerFIFO Open Failed");
+    if (useRing && session_use_ring(&session) == -1)
+        printf("<Client> the server refused the ring: using the FIFOs\n");
 
-    printf("<Client> making FIFO...\n");
-    // make a FIFO with the following permissions:
-    // user:  read, write
-    // group: write
-    // other: no permission
-    if(mkfifo(path2ClientFIFO, 0640) == -1) errExit("<Client> 2ClientFIFO Creation Failed");
+    time_t t;
+    srand((unsigned int) time(&t));
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    session_run(&session, n, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("<Client> %lu requests in %.3f s (%.0f requests/s), window %d, through %s\n",
+           n, elapsed, (elapsed > 0)? n / elapsed : 0, window,
+           (session.ring != NULL)? "a ring" : "the FIFOs");
+    printf("<Client> round trip: mean %.1f us, max %.1f us\n",
+           session.rttSumNs / 1e3 / n, session.rttMaxNs / 1e3);
+    printf("<Client> %lu writes, %lu reads (%.3f syscalls per request), %lu wrong responses\n",
+           session.writes, session.reads, (double) (session.writes + session.reads) / n,
+           session.wrong);
+    session_close(&session);
+}
 
-    printf("<Client> FIFO %s created!\n", path2ClientFIFO);
+int main (int argc, char *argv[]) {
 
-    // Step-2: The client opens the server's FIFO to send a Request
-    printf("<Client> opening FIFO %s...\n", path2ServerFIFO);
-    if((Fd2ServerFIFO = open(path2ServerFIFO, O_WRONLY)) == -1) errExit("<Client> 2ServerFIFO Open Failed");
+    unsigned long nRequests = 0;
+    int window = SESSION_WINDOW, nShards = 0, useRing = 0, opt;
+    while ((opt = getopt(argc, argv, "s:n:k:m")) != -1) {
+        switch (opt) {
+            case 's': nShards = atoi(optarg); break;
+            case 'n': nRequests = strtoul(optarg, NULL, 10); break;
+            case 'k': window = atoi(optarg); break;
+            case 'm': useRing = 1; break;
+            default:
+                usage(argv[0]);
+                return 0;
+        }
+    }
+    if (window <= 0 || window > SESSION_MAX_WINDOW || nShards < 0) {
+        usage(argv[0]);
+        return 0;
+    }
+    if (nRequests > 0) {
+        run_session(nRequests, window, nShards, useRing);
+        return 0;
+    }
+
+    // Step-1: The client opens the server's FIFO to send a Request
+    if((Fd2ServerFIFO = open_server_fifo(getpid(), nShards, path2ServerFIFO)) == -1) errExit("<Client> 2ServerFIFO Open Failed");
+    printf("<Client> FIFO %s opened\n", path2ServerFIFO);
+
+    // Step-2: The client leases a FIFO from the pool of the server,
+    // or makes a FIFO in /tmp if the pool is missing or full
+    char path2ClientFIFO [32];
+    int slot = -1;
+    struct FifoPool *pool = fifopool_attach();
+    if (pool != NULL)
+        slot = fifopool_lease(pool, getpid(), path2ClientFIFO);
+    if (slot != -1) {
+        printf("<Client> FIFO %s leased\n", path2ClientFIFO);
+    } else {
+        sprintf(path2ClientFIFO, "%s%d", baseClientFIFO, getpid());
+
+        printf("<Client> making FIFO...\n");
+        // make a FIFO with the following permissions:
+        // user:  read, write
+        // group: write
+        // other: no permission
+        if(mkfifo(path2ClientFIFO, 0640) == -1) errExit("<Client> 2ClientFIFO Creation Failed");
+
+        printf("<Client> FIFO %s created!\n", path2ClientFIFO);
+    }
 
     /* Intializes the random number generator */
     time_t t;
@@ -44,6 +115,8 @@ int main (int argc, char *argv[]) {
     struct Request request;
     request.cPid = getpid();
     request.code = (int) ( ((double)rand() / RAND_MAX) * 10);
+    request.seq = 0;
+    request.slot = slot;
 
     // Step-3: The client sends a Request through the server's FIFO
     printf("<Client> sending %d\n", request.code);
@@ -52,9 +125,18 @@ int main (int argc, char *argv[]) {
     // Step-4: The client opens its FIFO to get a Response
     if((Fd2ClientFIFO = open(path2ClientFIFO, O_RDONLY)) == -1) errExit("<Client> 2ClientFIFO Open Failed");
 
-    // Step-5: The client reads a Response from the server
+    // Step-5: The client reads a Response from the server. A FIFO of the
+    // pool may still hold the Responses to its former clients: they are
+    // skipped. If the server closes the FIFO first, it is opened again
     struct Response response;
-    if(read(Fd2ClientFIFO, &response, sizeof(struct Response)) == -1) errExit("<Client> 2ClientFIFO Read Failed");
+    ssize_t bR;
+    do {
+        if((bR = read(Fd2ClientFIFO, &response, sizeof(struct Response))) == -1) errExit("<Client> 2ClientFIFO Read Failed");
+        if (bR == 0) {
+            if(close(Fd2ClientFIFO) == -1) errExit("<Client> 2ClientFIFO Close Failed");
+            if((Fd2ClientFIFO = open(path2ClientFIFO, O_RDONLY)) == -1) errExit("<Client> 2ClientFIFO Open Failed");
+        }
+    } while (bR == 0 || response.cPid != request.cPid);
 
     // Step-6: The client prints the result on terminal
     printf("<Client> The server sent the result: %d\n", response.result);
@@ -62,6 +144,11 @@ int main (int argc, char *argv[]) {
     // Step-7: The client closes its FIFO
     if(close(Fd2ClientFIFO) == -1) errExit("<Client> 2ClientFIFO Close Failed");
 
-    // Step-8: The client removes its FIFO from the file system
-    if(unlink(path2ClientFIFO) != 0) errExit("<Client> 2ClientFIFO Remove Failed"); 
+    // Step-8: The client returns its FIFO to the pool, or removes it
+    // from the file system
+    if (slot != -1)
+        fifopool_release(pool, slot, request.cPid);
+    else if(unlink(path2ClientFIFO) != 0) errExit("<Client> 2ClientFIFO Remove Failed"); 
+    if (pool != NULL)
+        fifopool_detach(pool);
 }
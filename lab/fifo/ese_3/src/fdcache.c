@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "fdcache.h"
+#include "errExit.h"
+
+static int bucket_of (const struct FdCache *cache, pid_t cPid) {
+    // Fibonacci hashing: consecutive pids end up in different buckets
+    return (int) (((unsigned) cPid * 2654435769u) & (cache->nBuckets - 1));
+}
+
+// the index of the entry of cPid, -1 if cPid is not cached
+static int find (const struct FdCache *cache, pid_t cPid) {
+    for (int e = cache->buckets[bucket_of(cache, cPid)]; e != -1; e = cache->entries[e].chain)
+        if (cache->entries[e].cPid == cPid)
+            return e;
+    return -1;
+}
+
+static void unlink_lru (struct FdCache *cache, int e) {
+    struct FdEntry *entry = &cache->entries[e];
+    if (entry->prev != -1)
+        cache->entries[entry->prev].next = entry->next;
+    else
+        cache->head = entry->next;
+    if (entry->next != -1)
+        cache->entries[entry->next].prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+}
+
+static void push_front (struct FdCache *cache, int e) {
+    struct FdEntry *entry = &cache->entries[e];
+    entry->prev = -1;
+    entry->next = cache->head;
+    if (cache->head != -1)
+        cache->entries[cache->head].prev = e;
+    cache->head = e;
+    if (cache->tail == -1)
+        cache->tail = e;
+}
+
+// remove entry e from the cache, closing its descriptor.
+// The last entry is moved into the hole, so that the entries stay packed
+static void remove_entry (struct FdCache *cache, int e) {
+    struct FdEntry *entry = &cache->entries[e];
+    if (entry->fd != -1 && close(entry->fd) == -1)
+        errExit("close client FIFO failed");
+    cache->discarded += entry->count;
+
+    int *link = &cache->buckets[bucket_of(cache, entry->cPid)];
+    while (*link != e)
+        link = &cache->entries[*link].chain;
+    *link = entry->chain;
+    unlink_lru(cache, e);
+
+    int last = --cache->used;
+    if (e == last)
+        return;
+    // the references to the last entry now point to e
+    struct FdEntry *moved = &cache->entries[last];
+    link = &cache->buckets[bucket_of(cache, moved->cPid)];
+    while (*link != last)
+        link = &cache->entries[*link].chain;
+    *link = e;
+    if (moved->prev != -1)
+        cache->entries[moved->prev].next = e;
+    else
+        cache->head = e;
+    if (moved->next != -1)
+        cache->entries[moved->next].prev = e;
+    else
+        cache->tail = e;
+    *entry = *moved;
+}
+
+void fdcache_init(struct FdCache *cache, int capacity) {
+    cache->capacity = capacity;
+    cache->used = 0;
+    cache->nBuckets = 1;
+    while (cache->nBuckets < 2 * capacity)
+        cache->nBuckets <<= 1;
+    cache->entries = malloc(capacity * sizeof(struct FdEntry));
+    cache->buckets = malloc(cache->nBuckets * sizeof(int));
+    if (cache->entries == NULL || cache->buckets == NULL)
+        errExit("malloc failed");
+    for (int b = 0; b < cache->nBuckets; ++b)
+        cache->buckets[b] = -1;
+    cache->head = cache->tail = -1;
+    cache->hits = cache->misses = cache->evictions = cache->discarded = 0;
+}
+
+struct FdEntry *fdcache_get(struct FdCache *cache, pid_t cPid) {
+    int e = find(cache, cPid);
+    if (e == -1) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    if (cache->head != e) {
+        unlink_lru(cache, e);
+        push_front(cache, e);
+    }
+    return &cache->entries[e];
+}
+
+struct FdEntry *fdcache_find(struct FdCache *cache, pid_t cPid) {
+    int e = find(cache, cPid);
+    return (e == -1)? NULL : &cache->entries[e];
+}
+
+struct FdEntry *fdcache_put(struct FdCache *cache, pid_t cPid, int slot) {
+    if (cache->used == cache->capacity) {
+        remove_entry(cache, cache->tail);
+        cache->evictions++;
+    }
+    int e = cache->used++;
+    int b = bucket_of(cache, cPid);
+    struct FdEntry *entry = &cache->entries[e];
+    entry->cPid = cPid;
+    entry->slot = slot;
+    entry->fd = -1;
+    entry->prev = entry->next = -1;
+    entry->chain = cache->buckets[b];
+    entry->head = entry->count = 0;
+    entry->since = entry->retryAt = entry->backoff = 0;
+    cache->buckets[b] = e;
+    push_front(cache, e);
+    return entry;
+}
+
+void fdcache_drop(struct FdCache *cache, pid_t cPid) {
+    int e = find(cache, cPid);
+    if (e != -1)
+        remove_entry(cache, e);
+}
+
+void fdcache_free(struct FdCache *cache) {
+    for (int e = 0; e < cache->used; ++e) {
+        if (cache->entries[e].fd != -1 && close(cache->entries[e].fd) == -1)
+            errExit("close client FIFO failed");
+        cache->discarded += cache->entries[e].count;
+    }
+    free(cache->entries);
+    free(cache->buckets);
+    cache->entries = NULL;
+    cache->buckets = NULL;
+    cache->used = 0;
+}
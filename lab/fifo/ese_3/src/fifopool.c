@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fifopool.h"
+#include "errExit.h"
+
+static void slot_path (char *path, int slot) {
+    sprintf(path, "%s%d", POOL_FIFO_BASE, slot);
+}
+
+struct FifoPool *fifopool_create(int nSlots, int *shmid) {
+    size_t size = sizeof(struct FifoPool) + nSlots * sizeof(pid_t);
+    // get, or create, the lease table. The table of a server that did not
+    // terminate cleanly may be too small: it is removed first
+    *shmid = shmget(FIFO_POOL_KEY, size, IPC_CREAT | S_IRUSR | S_IWUSR);
+    if (*shmid == -1 && errno == EINVAL) {
+        int old = shmget(FIFO_POOL_KEY, 0, 0);
+        if (old == -1 || shmctl(old, IPC_RMID, NULL) == -1)
+            errExit("shmctl failed");
+        *shmid = shmget(FIFO_POOL_KEY, size, IPC_CREAT | S_IRUSR | S_IWUSR);
+    }
+    if (*shmid == -1)
+        errExit("Error creation SHM Mem");
+
+    struct FifoPool *pool = shmat(*shmid, NULL, 0);
+    if (pool == (void *) -1)
+        errExit("Error Mem Attach");
+    pool->nSlots = nSlots;
+    for (int i = 0; i < nSlots; ++i)
+        pool->holders[i] = 0;
+
+    // the FIFOs of a former server are used again
+    char path[32];
+    for (int i = 0; i < nSlots; ++i) {
+        slot_path(path, i);
+        if (mkfifo(path, 0640) == -1 && errno != EEXIST)
+            errExit("<Server> pool FIFO creation failed");
+    }
+    return pool;
+}
+
+void fifopool_remove(struct FifoPool *pool, int shmid) {
+    char path[32];
+    for (int i = 0; i < pool->nSlots; ++i) {
+        slot_path(path, i);
+        if (unlink(path) != 0 && errno != ENOENT)
+            errExit("unlink failed");
+    }
+    fifopool_detach(pool);
+    if (shmctl(shmid, IPC_RMID, NULL) == -1)
+        errExit("shmctl failed");
+}
+
+struct FifoPool *fifopool_attach(void) {
+    int shmid = shmget(FIFO_POOL_KEY, 0, 0);
+    if (shmid == -1)
+        return NULL;
+    struct FifoPool *pool = shmat(shmid, NULL, 0);
+    return (pool == (void *) -1)? NULL : pool;
+}
+
+int fifopool_lease(struct FifoPool *pool, pid_t cPid, char *path) {
+    // the clients start from different slots, so they rarely try the same one
+    int first = (int) ((unsigned) cPid % pool->nSlots);
+    for (int i = 0; i < pool->nSlots; ++i) {
+        int slot = (first + i) % pool->nSlots;
+        pid_t none = 0;
+        if (__atomic_compare_exchange_n(&pool->holders[slot], &none, cPid, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            slot_path(path, slot);
+            return slot;
+        }
+    }
+
+    // no free slot: take back a slot leased by a client that died.
+    // The pid of a dead holder may be used by a new process meanwhile:
+    // then the slot is taken back when that process terminates
+    for (int i = 0; i < pool->nSlots; ++i) {
+        int slot = (first + i) % pool->nSlots;
+        pid_t holder = __atomic_load_n(&pool->holders[slot], __ATOMIC_ACQUIRE);
+        if (holder == 0 || kill(holder, 0) == 0 || errno != ESRCH)
+            continue;
+        if (__atomic_compare_exchange_n(&pool->holders[slot], &holder, cPid, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            slot_path(path, slot);
+            return slot;
+        }
+    }
+    return -1;
+}
+
+void fifopool_release(struct FifoPool *pool, int slot, pid_t cPid) {
+    // the slot is not ours anymore if it was taken back
+    __atomic_compare_exchange_n(&pool->holders[slot], &cPid, 0, 0,
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+void fifopool_detach(struct FifoPool *pool) {
+    // detach the shared memory segment
+    if (shmdt(pool) == -1)
+        errExit("SHMdt failed");
+}
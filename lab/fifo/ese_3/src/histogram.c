@@ -0,0 +1,107 @@
+#include <string.h>
+
+#include "histogram.h"
+
+void hist_init(struct Histogram *hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+// find the bucket of a value: values lower than HIST_SUB_COUNT are stored exactly
+// in magnitude 0, the others in magnitude m with a resolution of 2^m ns
+static void bucket_of(uint64_t value, int *magnitude, int *sub) {
+    int m = 0;
+    if (value >= HIST_SUB_COUNT)
+        m = (63 - __builtin_clzll(value)) - HIST_SUB_BITS + 1;
+    if (m >= HIST_MAGNITUDES) {
+        m = HIST_MAGNITUDES - 1;
+        value = ((uint64_t) HIST_SUB_COUNT << m) - 1;
+    }
+    *magnitude = m;
+    *sub = (int) (value >> m);
+}
+
+// the highest value stored in a bucket
+static uint64_t value_of(int magnitude, int sub) {
+    return (((uint64_t) sub + 1) << magnitude) - 1;
+}
+
+void hist_record(struct Histogram *hist, uint64_t value) {
+    int m, s;
+    bucket_of(value, &m, &s);
+    hist->counts[m][s]++;
+    hist->total++;
+    hist->sum += value;
+    if (value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+void hist_merge(struct Histogram *hist, const struct Histogram *from) {
+    for (int m = 0; m < HIST_MAGNITUDES; ++m)
+        for (int s = 0; s < HIST_SUB_COUNT; ++s)
+            hist->counts[m][s] += from->counts[m][s];
+    hist->total += from->total;
+    hist->sum += from->sum;
+    if (from->min < hist->min)
+        hist->min = from->min;
+    if (from->max > hist->max)
+        hist->max = from->max;
+}
+
+uint64_t hist_percentile(const struct Histogram *hist, double percentile) {
+    if (hist->total == 0)
+        return 0;
+
+    // the rank of the wanted value (at least the first one)
+    uint64_t rank = (uint64_t) (percentile / 100.0 * hist->total + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (int m = 0; m < HIST_MAGNITUDES; ++m)
+        for (int s = 0; s < HIST_SUB_COUNT; ++s) {
+            seen += hist->counts[m][s];
+            if (seen >= rank) {
+                // a bucket can not report more than the exact max
+                uint64_t value = value_of(m, s);
+                return (value < hist->max)? value : hist->max;
+            }
+        }
+    return hist->max;
+}
+
+void hist_print(const struct Histogram *hist, FILE *out) {
+    if (hist->total == 0) {
+        fprintf(out, "<Loadgen> no samples\n");
+        return;
+    }
+
+    fprintf(out, "<Loadgen> samples %llu\n", (unsigned long long) hist->total);
+    fprintf(out, "<Loadgen> min   %10.3f us\n", hist->min / 1000.0);
+    fprintf(out, "<Loadgen> mean  %10.3f us\n", hist->sum / hist->total / 1000.0);
+
+    const double percentiles[] = {50, 90, 99, 99.9};
+    const char *names[] = {"p50", "p90", "p99", "p99.9"};
+    for (int i = 0; i < 4; ++i)
+        fprintf(out, "<Loadgen> %-5s %10.3f us\n", names[i],
+                hist_percentile(hist, percentiles[i]) / 1000.0);
+
+    fprintf(out, "<Loadgen> max   %10.3f us\n", hist->max / 1000.0);
+}
+
+void hist_csv(const struct Histogram *hist, FILE *out) {
+    fprintf(out, "latency_ns,count,cumulative\n");
+
+    uint64_t seen = 0;
+    for (int m = 0; m < HIST_MAGNITUDES; ++m)
+        for (int s = 0; s < HIST_SUB_COUNT; ++s) {
+            uint64_t count = hist->counts[m][s];
+            if (count == 0)
+                continue;
+            seen += count;
+            fprintf(out, "%llu,%llu,%.6f\n", (unsigned long long) value_of(m, s),
+                    (unsigned long long) count, (double) seen / hist->total);
+        }
+}
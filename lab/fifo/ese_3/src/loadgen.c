@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "histogram.h"
+#include "session.h"
+#include "errExit.h"
+
+// loadgen measures the FIFO server: it forks many clients, each running a
+// session of M Requests, closed loop or at a fixed rate. The clients record
+// their round trips in a mapping shared with the parent, which merges them
+// and reports throughput and latency percentiles
+
+// the results of a client, written in the shared mapping
+struct ClientStats {
+    struct Histogram hist;
+    unsigned long requests, wrong, writes, reads;
+    int failed;                 /* 1: the server FIFO was not found      */
+    int ring;                   /* 1: served through a ring              */
+};
+
+// the mapping shared by the parent and the clients
+struct LoadStats {
+    int ready;                  /* clients with an open session          */
+    struct ClientStats clients[];
+};
+
+static void usage (const char *prog) {
+    printf("Usage: %s [-c clients] [-n requests] [-k window] [-r rate] [-s shards] [-m] [-o csvFile] [-H histCsvFile]\n", prog);
+    printf("  -c  client processes (default 4)\n");
+    printf("  -n  requests sent by each client (default 10000)\n");
+    printf("  -k  requests each client keeps waiting for a response (default 1, max %d)\n",
+           SESSION_MAX_WINDOW);
+    printf("  -r  total requests per second, shared by the clients (default 0: closed loop)\n");
+    printf("  -s  the server is sharded in so many FIFOs\n");
+    printf("  -m  the clients ask for a shared memory ring (the FIFOs if refused)\n");
+    printf("  -o  append a CSV line with the results to csvFile\n");
+    printf("  -H  write the latency histogram as CSV\n");
+}
+
+static double now_s (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void client (struct LoadStats *stats, int index, unsigned long n, int window,
+                    double rate, int nShards, int useRing, int startFD) {
+    struct ClientStats *mine = &stats->clients[index];
+    srand(getpid());
+
+    struct Session session;
+    if (session_open(&session, window, nShards) == -1) {
+        mine->failed = 1;
+        return;
+    }
+    session.hist = &mine->hist;
+    mine->ring = useRing && session_use_ring(&session) == 0;
+
+    // all the clients start together: the parent closes the start pipe
+    __atomic_add_fetch(&stats->ready, 1, __ATOMIC_RELEASE);
+    char c;
+    if (read(startFD, &c, 1) == -1)
+        errExit("read start pipe failed");
+
+    session_run(&session, n, rate);
+    mine->requests = n;
+    mine->wrong = session.wrong;
+    mine->writes = session.writes;
+    mine->reads = session.reads;
+    session_close(&session);
+}
+
+int main (int argc, char *argv[]) {
+    int nClients = 4, window = 1, nShards = 0, useRing = 0, opt;
+    unsigned long nRequests = 10000;
+    double rate = 0;
+    const char *csvPath = NULL, *histPath = NULL;
+    while ((opt = getopt(argc, argv, "c:n:k:r:s:mo:H:")) != -1) {
+        switch (opt) {
+            case 'c': nClients = atoi(optarg); break;
+            case 'n': nRequests = strtoul(optarg, NULL, 10); break;
+            case 'k': window = atoi(optarg); break;
+            case 'r': rate = atof(optarg); break;
+            case 's': nShards = atoi(optarg); break;
+            case 'm': useRing = 1; break;
+            case 'o': csvPath = optarg; break;
+            case 'H': histPath = optarg; break;
+            default:
+                usage(argv[0]);
+                return 0;
+        }
+    }
+    if (nClients <= 0 || nRequests == 0 || window <= 0 || window > SESSION_MAX_WINDOW || rate < 0 || nShards < 0) {
+        usage(argv[0]);
+        return 0;
+    }
+
+    // a histogram for each client: the clients never write the same pages
+    size_t mappingSize = sizeof(struct LoadStats) + nClients * sizeof(struct ClientStats);
+    struct LoadStats *stats = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED)
+        errExit("mmap failed");
+    for (int i = 0; i < nClients; ++i)
+        hist_init(&stats->clients[i].hist);
+
+    int startPipe[2];
+    if (pipe(startPipe) == -1)
+        errExit("pipe failed");
+
+    fflush(stdout);
+    for (int i = 0; i < nClients; ++i) {
+        switch (fork()) {
+            case -1:
+                errExit("fork failed");
+                break;
+            case 0:
+                close(startPipe[1]);
+                client(stats, i, nRequests, window, rate / nClients, nShards, useRing, startPipe[0]);
+                _exit(0);
+        }
+    }
+    close(startPipe[0]);
+
+    // wait for the sessions to be open (or for the clients that could not
+    // open one to exit), then start the clients
+    int exited = 0;
+    while (__atomic_load_n(&stats->ready, __ATOMIC_ACQUIRE) + exited < nClients) {
+        if (waitpid(-1, NULL, WNOHANG) > 0)
+            exited++;
+        else
+            usleep(1000);
+    }
+    double start = now_s();
+    if (close(startPipe[1]) == -1)
+        errExit("close failed");
+    while (wait(NULL) != -1)
+        ;
+    double elapsed = now_s() - start;
+
+    struct Histogram total;
+    hist_init(&total);
+    unsigned long requests = 0, wrong = 0, syscalls = 0;
+    int failed = 0, rings = 0;
+    for (int i = 0; i < nClients; ++i) {
+        struct ClientStats *c = &stats->clients[i];
+        hist_merge(&total, &c->hist);
+        requests += c->requests;
+        wrong += c->wrong;
+        syscalls += c->writes + c->reads;
+        failed += c->failed;
+        rings += c->ring;
+    }
+    if (failed > 0)
+        printf("<Loadgen> %d clients could not open a server FIFO\n", failed);
+
+    double throughput = (elapsed > 0)? requests / elapsed : 0;
+    printf("<Loadgen> %d clients, window %d, %s, %d shards, %d through a ring\n", nClients, window,
+           (rate > 0)? "open loop" : "closed loop", nShards, rings);
+    printf("<Loadgen> %lu requests in %.3f s: %.0f requests/s, %.3f client syscalls per request, %lu wrong responses\n",
+           requests, elapsed, throughput, requests? (double) syscalls / requests : 0, wrong);
+    hist_print(&total, stdout);
+
+    if (csvPath != NULL) {
+        // a header is written only in a new file
+        struct stat st;
+        int empty = stat(csvPath, &st) == -1 || st.st_size == 0;
+        FILE *csv = fopen(csvPath, "a");
+        if (csv == NULL)
+            errExit("fopen csv failed");
+        if (empty)
+            fprintf(csv, "clients,shards,rings,requests,window,rate,seconds,requests_per_s,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,wrong\n");
+        fprintf(csv, "%d,%d,%d,%lu,%d,%.0f,%.6f,%.0f,%llu,%llu,%llu,%llu,%llu,%lu\n",
+                nClients, nShards, rings, requests, window, rate, elapsed, throughput,
+                (unsigned long long) hist_percentile(&total, 50),
+                (unsigned long long) hist_percentile(&total, 90),
+                (unsigned long long) hist_percentile(&total, 99),
+                (unsigned long long) hist_percentile(&total, 99.9),
+                (unsigned long long) total.max, wrong);
+        if (fclose(csv) == EOF)
+            errExit("fclose csv failed");
+        printf("<Loadgen> results appended to %s\n", csvPath);
+    }
+    if (histPath != NULL) {
+        FILE *csv = fopen(histPath, "w");
+        if (csv == NULL)
+            errExit("fopen csv failed");
+        hist_csv(&total, csv);
+        if (fclose(csv) == EOF)
+            errExit("fclose csv failed");
+        printf("<Loadgen> histogram written to %s\n", histPath);
+    }
+
+    munmap(stats, mappingSize);
+    return (failed > 0)? 1 : 0;
+}
@@ -0,0 +1,83 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ring.h"
+#include "errExit.h"
+
+// tell the CPU this is a busy wait
+static inline void relax (void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+uint32_t ring_push(struct RingIndex *index, void *items, size_t size, const void *src, uint32_t n) {
+    uint32_t head = index->head;
+    uint32_t tail = __atomic_load_n(&index->tail, __ATOMIC_ACQUIRE);
+    if (n > RING_SIZE - (head - tail))
+        n = RING_SIZE - (head - tail);
+    for (uint32_t i = 0; i < n; ++i)
+        memcpy((char *) items + ((head + i) & (RING_SIZE - 1)) * size, (const char *) src + i * size, size);
+    // sequentially consistent: either the consumer sees the new head
+    // before sleeping, or ring_wake sees it sleeping
+    __atomic_store_n(&index->head, head + n, __ATOMIC_SEQ_CST);
+    return n;
+}
+
+uint32_t ring_pop(struct RingIndex *index, const void *items, size_t size, void *dst, uint32_t n) {
+    uint32_t tail = index->tail;
+    uint32_t head = __atomic_load_n(&index->head, __ATOMIC_ACQUIRE);
+    if (n > head - tail)
+        n = head - tail;
+    for (uint32_t i = 0; i < n; ++i)
+        memcpy((char *) dst + i * size, (const char *) items + ((tail + i) & (RING_SIZE - 1)) * size, size);
+    __atomic_store_n(&index->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+int ring_wake(struct RingIndex *index) {
+    if (__atomic_load_n(&index->sleepers, __ATOMIC_SEQ_CST) == 0)
+        return 0;
+    // the ring is shared by two processes: not a FUTEX_PRIVATE futex
+    if (syscall(SYS_futex, &index->head, FUTEX_WAKE, 1, NULL, NULL, 0) == -1)
+        errExit("futex wake failed");
+    return 1;
+}
+
+// spinning is useful only if the other side runs on another CPU
+static int spins (void) {
+    static int n = -1;
+    if (n == -1)
+        n = (sysconf(_SC_NPROCESSORS_ONLN) > 1)? RING_SPIN : 0;
+    return n;
+}
+
+int ring_wait(struct RingIndex *index, uint64_t timeoutNs) {
+    uint32_t tail = index->tail;
+    for (int i = spins(); i > 0; --i) {
+        if (__atomic_load_n(&index->head, __ATOMIC_ACQUIRE) != tail)
+            return 0;
+        relax();
+    }
+
+    __atomic_add_fetch(&index->sleepers, 1, __ATOMIC_SEQ_CST);
+    int slept = 1;
+    // the futex sleeps only if head is still tail: an item pushed
+    // meanwhile makes it return at once
+    if (__atomic_load_n(&index->head, __ATOMIC_SEQ_CST) == tail) {
+        struct timespec timeout = {.tv_sec = timeoutNs / 1000000000ull, .tv_nsec = timeoutNs % 1000000000ull};
+        if (syscall(SYS_futex, &index->head, FUTEX_WAIT, tail, (timeoutNs > 0)? &timeout : NULL, NULL, 0) == -1) {
+            if (errno == ETIMEDOUT)
+                slept = -1;
+            else if (errno != EAGAIN && errno != EINTR)
+                errExit("futex wait failed");
+        }
+    }
+    __atomic_sub_fetch(&index->sleepers, 1, __ATOMIC_SEQ_CST);
+    return slept;
+}
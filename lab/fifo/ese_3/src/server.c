@@ -1,26 +1,80 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <getopt.h>
 
 #include "errExit.h"
 #include "request_response.h"
+#include "fifopool.h"
+#include "workers.h"
 
-char *path2ServerFIFO ="/tmp/fifo_server";
-char *baseClientFIFO = "/tmp/fifo_client.";
+char *path2ServerFIFO = SERVER_FIFO;
+
+// the path of the FIFO of a shard
+char path2ShardFIFO [32];
+
+// the processes serving the shards (sharded mode only)
+pid_t *shardPids;
+int nShards;
 
 // the file descriptor entry for the FIFO
-int serverFIFO, serverFIFO_extra, clientFIFO;
+int serverFIFO, serverFIFO_extra;
 
-// the quit function closes the file descriptors for the FIFO,
-// removes the FIFO from the file system, and terminates the process
+// the workers answering the Requests
+struct WorkerPool pool;
+
+// the FIFOs leased by the clients (made and removed by the first process)
+struct FifoPool *fifoPool;
+int fifoPoolId;
+
+// default Requests read from the server FIFO with a single read
+#define REQUEST_BATCH 512
+
+// how the server FIFO was drained
+struct DrainStats {
+    unsigned long reads;        /* read calls on the server FIFO          */
+    unsigned long batches;      /* reads returning at least one Request   */
+    unsigned long requests;     /* whole Requests read                    */
+} drainStats;
+
+// the signal (SIGINT or SIGALRM) ending serve(), written by quit to quitPipe
+volatile sig_atomic_t quitSignal;
+int quitPipe[2] = {-1, -1};
+
+// the quit function is the signal handler for SIGALRM and SIGINT: it only
+// wakes up serve(), which stops the workers and then runs terminate()
 void quit(int sig) {
-    // the quit function is used as signal handler for the ALARM signal too.
+    int savedErrno = errno;
+    quitSignal = sig;
+    // the pipe is non-blocking: a pending byte is enough
+    if (write(quitPipe[1], "q", 1) == -1) {}
+    errno = savedErrno;
+}
+
+// the terminate function closes the file descriptors for the FIFO,
+// removes the FIFO from the file system, and terminates the process
+static void terminate (int sig) {
     if (sig == SIGALRM)
         printf("<Server> Time expired!\n");
 
+    if (pool.workers != NULL)
+        pool_report(&pool);
+    if (drainStats.batches > 0)
+        printf("<Server> %lu requests in %lu batches: %.1f requests per batch, %.3f reads per request\n",
+               drainStats.requests, drainStats.batches,
+               (double) drainStats.requests / drainStats.batches,
+               (double) drainStats.reads / drainStats.requests);
+
     // Close the FIFO
     if (serverFIFO != 0 && close(serverFIFO) == -1)
         errExit("close failed");
@@ -32,34 +86,32 @@ void quit(int sig) {
     if (unlink(path2ServerFIFO) != 0)
         errExit("unlink failed");
 
-    // terminatethe process
+    // Remove the FIFOs of the pool
+    if (fifoPool != NULL)
+        fifopool_remove(fifoPool, fifoPoolId);
+
+    // terminatethe process (_exit does not flush stdout)
+    fflush(stdout);
     _exit(0);
 }
 
-void sendResponse(struct Request *request) {
-
-    // make the path of client's FIFO
-    char path2ClientFIFO [25];
-    sprintf(path2ClientFIFO, "%s%d", baseClientFIFO, request->cPid);
-
-    printf("<Server> opening FIFO %s...\n", path2ClientFIFO);
-    // Open the client's FIFO in write-only mode
-    if((clientFIFO = open(path2ClientFIFO, O_WRONLY)) == -1) errExit("<Server> C_Creation Failed"); 
-
-    // Prepare the response for the client
-    struct Response response;
-    response.result = request->code * request->code;
-
-    printf("<Server> sending a response\n");
-    // Write the Response into the opened FIFO
-    if(write(clientFIFO, request, sizeof(struct Request)) == -1) errExit("<Server> C_Writing Failed");
-
-    // Close the FIFO
-    if(close(clientFIFO) == -1) errExit("<Server> C_Closing FIFO Failed");
+static void usage (const char *prog) {
+    printf("Usage: %s [-s shards] [-w workers] [-c cacheSize] [-b batch] [-t timeoutMs] [-p poolSize] [-q]\n", prog);
+    printf("  -s  serve %s.0 ... %s.<shards-1>, each FIFO with its own process pinned to a core\n",
+           SERVER_FIFO, SERVER_FIFO);
+    printf("  -w  threads answering the requests (default: %d for each core, or for each shard)\n",
+           WORKERS_PER_CORE);
+    printf("  -c  client FIFOs kept open by each worker (default %d)\n", FD_CACHE_SIZE);
+    printf("  -b  max requests read at once from the server FIFO (default %d)\n", REQUEST_BATCH);
+    printf("  -t  evict a client not taking its responses for so many ms (default %d)\n", CLIENT_TIMEOUT_MS);
+    printf("  -p  FIFOs leased by the clients, in %s<slot> (default %d, 0: no pool)\n",
+           POOL_FIFO_BASE, FIFO_POOL_SIZE);
+    printf("  -q  no message for each request\n");
 }
 
-int main (int argc, char *argv[]) {
-
+// make the FIFO path2ServerFIFO and answer the Requests read from it,
+// until SIGINT or 30 seconds without Requests
+static void serve (int nWorkers, int cacheSize, int batch, int evictMs, int verbose) {
     printf("<Server> Making FIFO...\n");
     // make a FIFO with the following permissions:
     // user:  read, write
@@ -70,28 +122,55 @@ int main (int argc, char *argv[]) {
     printf("<Server> FIFO %s created!\n", path2ServerFIFO);
 
     // set a signal handler for SIGALRM and SIGINT signals
+    if (pipe2(quitPipe, O_NONBLOCK | O_CLOEXEC) == -1)
+        errExit("pipe failed");
     signal(SIGALRM, quit);
     signal(SIGINT, quit);
 
     // setting a 30 seconds alarm
     alarm(30);
 
-    // Wait for client in read-only mode. The open blocks the calling process
-    // until another process opens the same FIFO in write-only mode
+    // Open the FIFO in read-only mode without waiting for a client, so that
+    // a signal can stop the server before the first one arrives
     printf("<Server> waiting for a client...\n");
-    if((serverFIFO = open(path2ServerFIFO, O_RDONLY)) == -1) errExit("<Server> Open FIFO Failed");
+    if((serverFIFO = open(path2ServerFIFO, O_RDONLY | O_NONBLOCK)) == -1) errExit("<Server> Open FIFO Failed");
 
     // Open an extra descriptor, so that the server does not see end-of-file
     // even if all clients closed the write end of the FIFO
     serverFIFO_extra = open(path2ServerFIFO, O_WRONLY);
     if (serverFIFO_extra == -1) errExit("open write-only failed");
 
-    struct Request request;
-    int bR = -1;
-    do {
-        printf("<Server> waiting for a Request...\n");
-        // Read a request from the FIFO
-        bR = read(serverFIFO, &request, sizeof(struct Request));
+    // poll tells when the Requests arrive: the reads can block again
+    if (fcntl(serverFIFO, F_SETFL, 0) == -1)
+        errExit("fcntl failed");
+
+    // the Requests are answered by the workers: this thread only reads them
+    pool_start(&pool, nWorkers, cacheSize, evictMs, verbose);
+    printf("<Server> %d workers, %d client FIFOs cached by each one\n", nWorkers, cacheSize);
+
+    // under load the FIFO holds many Requests: a single read takes all of
+    // them (up to batch). The bytes of a Request cut by the read stay at
+    // the beginning of the buffer, and the next read completes it
+    struct Request *requests = malloc(batch * sizeof(struct Request));
+    if (requests == NULL)
+        errExit("malloc failed");
+    size_t pending = 0;
+    struct pollfd fds[2] = {{.fd = serverFIFO, .events = POLLIN}, {.fd = quitPipe[0], .events = POLLIN}};
+    for (;;) {
+        if (verbose)
+            printf("<Server> waiting for a Request...\n");
+        // wait for Requests, or for a signal handled by quit()
+        if (poll(fds, 2, -1) == -1) {
+            if (errno != EINTR)
+                errExit("poll failed");
+            continue;
+        }
+        if (fds[1].revents & POLLIN)
+            break;
+
+        // Read the available Requests from the FIFO
+        ssize_t bR = read(serverFIFO, (char *) requests + pending, batch * sizeof(struct Request) - pending);
+        drainStats.reads++;
 
         // remove the alarm
         alarm(0);
@@ -99,16 +178,118 @@ int main (int argc, char *argv[]) {
         // Check the number of bytes read from the FIFO
         if (bR == -1) {
             printf("<Server> it looks like the FIFO is broken\n");
-        } else if ((unsigned long) bR < sizeof(struct Request))
-            printf("<Server> it looks like I did not receive a valid request\n");
-        else
-            sendResponse(&request);
+            break;
+        }
+        pending += bR;
+        size_t n = pending / sizeof(struct Request);
+        if (n > 0) {
+            pool_dispatch_batch(&pool, requests, n);
+            drainStats.batches++;
+            drainStats.requests += n;
+
+            pending -= n * sizeof(struct Request);
+            memmove(requests, requests + n, pending);
+        }
 
         // reset the alarm
         alarm(30);
-    } while (bR != -1);
+    }
+    free(requests);
+
+    // a signal arrived, or the FIFO is broken: answer the queued Requests,
+    // then run terminate() to remove the FIFO and terminate the process.
+    pool_stop(&pool);
+    terminate(quitSignal);
+}
+
+// forward SIGINT to the shards
+static void stop_shards (int sig) {
+    (void) sig;
+    for (int i = 0; i < nShards; ++i)
+        kill(shardPids[i], SIGINT);
+}
+
+int main (int argc, char *argv[]) {
+
+    int nWorkers = 0, cacheSize = FD_CACHE_SIZE, verbose = 1, opt;
+    int batch = REQUEST_BATCH, evictMs = CLIENT_TIMEOUT_MS, poolSize = FIFO_POOL_SIZE;
+    while ((opt = getopt(argc, argv, "s:w:c:b:t:p:q")) != -1) {
+        switch (opt) {
+            case 's': nShards = atoi(optarg); break;
+            case 'w': nWorkers = atoi(optarg); break;
+            case 'c': cacheSize = atoi(optarg); break;
+            case 'b': batch = atoi(optarg); break;
+            case 't': evictMs = atoi(optarg); break;
+            case 'p': poolSize = atoi(optarg); break;
+            case 'q': verbose = 0; break;
+            default:
+                usage(argv[0]);
+                return 0;
+        }
+    }
+    if (nWorkers < 0 || cacheSize <= 0 || batch <= 0 || evictMs <= 0 || nShards < 0 || poolSize < 0) {
+        usage(argv[0]);
+        return 0;
+    }
+
+    // the pool is shared by all the shards
+    if (poolSize > 0) {
+        fifoPool = fifopool_create(poolSize, &fifoPoolId);
+        printf("<Server> %d FIFOs %s<slot> in the pool\n", poolSize, POOL_FIFO_BASE);
+    }
+
+    if (nShards == 0) {
+        serve((nWorkers > 0)? nWorkers : default_workers(), cacheSize, batch, evictMs, verbose);
+        return 0;
+    }
+
+    // a shard is served by a process pinned to a single core
+    shardPids = malloc(nShards * sizeof(pid_t));
+    if (shardPids == NULL)
+        errExit("malloc failed");
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        errExit("sched_getaffinity failed");
+    int nCores = CPU_COUNT(&allowed);
+
+    fflush(stdout);
+    for (int i = 0; i < nShards; ++i) {
+        // the i-th core (modulo the number of cores) this process may use
+        int cpu = -1;
+        for (int seen = -1; seen < i % nCores; )
+            if (CPU_ISSET(++cpu, &allowed))
+                seen++;
+
+        switch (shardPids[i] = fork()) {
+            case -1:
+                errExit("fork failed");
+                break;
+            case 0: {
+                cpu_set_t one;
+                CPU_ZERO(&one);
+                CPU_SET(cpu, &one);
+                if (sched_setaffinity(0, sizeof(one), &one) == -1)
+                    errExit("sched_setaffinity failed");
+
+                free(shardPids);
+                shardPids = NULL;
+                // the pool is removed by the parent
+                fifoPool = NULL;
+                sprintf(path2ShardFIFO, "%s.%d", SERVER_FIFO, i);
+                path2ServerFIFO = path2ShardFIFO;
+                printf("<Server> shard %d on core %d\n", i, cpu);
+                serve((nWorkers > 0)? nWorkers : WORKERS_PER_CORE, cacheSize, batch, evictMs, verbose);
+                _exit(0);
+            }
+        }
+    }
 
-    // the FIFO is broken, run quit() to remove the FIFO and
-    // terminate the process.
-    quit(0);
+    // SIGINT stops all the shards: each one removes its FIFO
+    signal(SIGINT, stop_shards);
+    while (wait(NULL) != -1 || errno == EINTR)
+        ;
+    free(shardPids);
+    if (fifoPool != NULL)
+        fifopool_remove(fifoPool, fifoPoolId);
+    return 0;
 }
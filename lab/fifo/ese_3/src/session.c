@@ -0,0 +1,258 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+
+#include <sys/stat.h>
+#include <sys/shm.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "session.h"
+#include "errExit.h"
+
+static uint64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// the shard of a client: Fibonacci hashing spreads consecutive pids
+static int shard_of (pid_t cPid, int nShards) {
+    uint32_t hash = (uint32_t) cPid * 2654435769u;
+    return (int) (((uint64_t) hash * nShards) >> 32);
+}
+
+int open_server_fifo(pid_t cPid, int nShards, char *path) {
+    int first = (nShards > 0)? shard_of(cPid, nShards) : 0;
+    for (int i = 0; i < nShards; ++i) {
+        sprintf(path, "%s.%d", SERVER_FIFO, (first + i) % nShards);
+        int fd = open(path, O_WRONLY);
+        if (fd != -1)
+            return fd;
+        if (errno != ENOENT)
+            errExit("<Client> 2ServerFIFO Open Failed");
+    }
+    if (nShards > 0)
+        printf("<Client> no shard of %s found\n", SERVER_FIFO);
+    strcpy(path, SERVER_FIFO);
+    return open(path, O_WRONLY);
+}
+
+int session_open(struct Session *session, int window, int nShards) {
+    memset(session, 0, sizeof(struct Session));
+    session->cPid = getpid();
+    session->window = window;
+
+    session->serverFIFO = open_server_fifo(session->cPid, nShards, session->path2ServerFIFO);
+    if (session->serverFIFO == -1)
+        return -1;
+
+    // a FIFO of the pool costs no mkfifo and no unlink
+    session->lease = -1;
+    session->pool = fifopool_attach();
+    if (session->pool != NULL)
+        session->lease = fifopool_lease(session->pool, session->cPid, session->path2ClientFIFO);
+    if (session->lease == -1) {
+        sprintf(session->path2ClientFIFO, "%s%d", CLIENT_FIFO_BASE, session->cPid);
+        if (mkfifo(session->path2ClientFIFO, 0640) == -1)
+            errExit("<Client> 2ClientFIFO Creation Failed");
+    }
+
+    // the read end is opened without waiting for the server; the extra write
+    // end makes read wait for the Responses instead of returning end-of-file
+    // before the server opens the FIFO
+    session->clientFIFO = open(session->path2ClientFIFO, O_RDONLY | O_NONBLOCK);
+    if (session->clientFIFO == -1)
+        errExit("<Client> 2ClientFIFO Open Failed");
+    session->clientFIFO_extra = open(session->path2ClientFIFO, O_WRONLY);
+    if (session->clientFIFO_extra == -1)
+        errExit("<Client> 2ClientFIFO Open Failed");
+    if (fcntl(session->clientFIFO, F_SETFL, 0) == -1)
+        errExit("fcntl failed");
+    return 0;
+}
+
+int session_use_ring(struct Session *session) {
+    int shmid = shmget(IPC_PRIVATE, sizeof(struct Ring), IPC_CREAT | S_IRUSR | S_IWUSR);
+    if (shmid == -1)
+        errExit("Error creation SHM Mem");
+    struct Ring *ring = shmat(shmid, NULL, 0);
+    if (ring == (void *) -1)
+        errExit("Error Mem Attach");
+    // a new segment is filled with zeros: both rings are empty
+    ring->cPid = session->cPid;
+
+    struct Request request = {
+        .cPid = session->cPid, .code = RING_CONNECT, .seq = (uint32_t) shmid, .slot = session->lease
+    };
+    if (write(session->serverFIFO, &request, sizeof(request)) == -1)
+        errExit("<Client> 2ServerFIFO Write Failed");
+
+    // the answer comes through the client FIFO, after the Responses to
+    // the former client of a FIFO of the pool
+    struct Response response;
+    do {
+        if (read(session->clientFIFO, &response, sizeof(response)) != sizeof(response))
+            errExit("<Client> 2ClientFIFO Read Failed");
+    } while (response.cPid != session->cPid);
+
+    // the segment is destroyed when both processes detach it
+    if (shmctl(shmid, IPC_RMID, NULL) == -1)
+        errExit("shmctl failed");
+    if (response.result != 0) {
+        if (shmdt(ring) == -1)
+            errExit("SHMdt failed");
+        return -1;
+    }
+    session->ring = ring;
+    return 0;
+}
+
+// match the whole Responses in the buffer with their Requests
+static void match (struct Session *session, uint64_t now) {
+    size_t n = session->pending / sizeof(struct Response);
+    const struct Response *responses = (const struct Response *) session->buffer;
+    for (size_t i = 0; i < n; ++i) {
+        // a Response to the former client of a FIFO of the pool
+        if (responses[i].cPid != session->cPid)
+            continue;
+        uint32_t seq = responses[i].seq;
+        int slot = seq % session->window;
+        if (seq - session->oldest >= session->next - session->oldest || session->answered[slot]) {
+            printf("<Client> unexpected response %u\n", seq);
+            session->wrong++;
+            continue;
+        }
+        session->answered[slot] = 1;
+        if (responses[i].result != session->codes[slot] * session->codes[slot])
+            session->wrong++;
+
+        uint64_t rtt = now - session->sentNs[slot];
+        session->rttSumNs += rtt;
+        if (rtt > session->rttMaxNs)
+            session->rttMaxNs = rtt;
+        if (session->hist != NULL)
+            hist_record(session->hist, rtt);
+    }
+
+    // the window moves past the answered Requests
+    while (session->oldest != session->next && session->answered[session->oldest % session->window]) {
+        session->answered[session->oldest % session->window] = 0;
+        session->oldest++;
+    }
+
+    // keep the bytes of a cut Response
+    session->pending -= n * sizeof(struct Response);
+    memmove(session->buffer, session->buffer + n * sizeof(struct Response), session->pending);
+}
+
+void session_run(struct Session *session, unsigned long n, double rate) {
+    uint32_t first = session->next, last = session->next + n;
+    uint64_t start = now_ns();
+    double periodNs = (rate > 0)? 1e9 / rate : 0;
+    struct Request requests[SESSION_MAX_WINDOW];
+    while (session->oldest != last) {
+        // fill the window with the Requests due, sending them with a single write
+        int k = 0;
+        uint64_t now = now_ns(), due = now;
+        while (session->next != last && session->next - session->oldest < (uint32_t) session->window) {
+            if (rate > 0) {
+                due = start + (uint64_t) ((session->next - first) * periodNs);
+                if (due > now)
+                    break;
+            }
+            int slot = session->next % session->window;
+            session->codes[slot] = rand() % 10000;
+            session->sentNs[slot] = due;
+            requests[k++] = (struct Request) {
+                .cPid = session->cPid, .code = session->codes[slot], .seq = session->next,
+                .slot = session->lease
+            };
+            session->next++;
+        }
+        if (k > 0 && session->ring != NULL) {
+            // the window is at most RING_SIZE: the ring has room
+            struct Ring *ring = session->ring;
+            ring_push(&ring->requestIndex, ring->requests, sizeof(struct Request), requests, k);
+            session->writes += ring_wake(&ring->requestIndex);
+        } else if (k > 0) {
+            if (write(session->serverFIFO, requests, k * sizeof(struct Request)) == -1)
+                errExit("<Client> 2ServerFIFO Write Failed");
+            session->writes++;
+        }
+
+        // with a rate, wait for the Responses only until the next Request is due
+        int timed = rate > 0 && session->next != last &&
+                    session->next - session->oldest < (uint32_t) session->window;
+        if (timed) {
+            due = start + (uint64_t) ((session->next - first) * periodNs);
+            now = now_ns();
+            uint64_t waitNs = (due > now)? due - now : 0;
+            if (session->ring != NULL) {
+                if (waitNs > 0)
+                    session->reads += ring_wait(&session->ring->responseIndex, waitNs) == 1;
+            } else {
+                struct timespec timeout = {.tv_sec = waitNs / 1000000000ull, .tv_nsec = waitNs % 1000000000ull};
+                struct pollfd pfd = {.fd = session->clientFIFO, .events = POLLIN};
+                int ready = ppoll(&pfd, 1, &timeout, NULL);
+                if (ready == -1 && errno != EINTR)
+                    errExit("ppoll failed");
+                if (ready <= 0)
+                    continue;
+            }
+        }
+
+        // take all the Responses in the ring, or wait for the first one
+        if (session->ring != NULL) {
+            struct Ring *ring = session->ring;
+            uint32_t room = (sizeof(session->buffer) - session->pending) / sizeof(struct Response);
+            uint32_t got = ring_pop(&ring->responseIndex, ring->responses, sizeof(struct Response),
+                                    session->buffer + session->pending, room);
+            if (got == 0) {
+                if (!timed)
+                    session->reads += ring_wait(&ring->responseIndex, 0) == 1;
+                continue;
+            }
+            session->pending += got * sizeof(struct Response);
+            match(session, now_ns());
+            continue;
+        }
+
+        // read all the Responses that arrived
+        ssize_t bR = read(session->clientFIFO, session->buffer + session->pending,
+                          sizeof(session->buffer) - session->pending);
+        if (bR == -1) {
+            if (errno == EINTR)
+                continue;
+            errExit("<Client> 2ClientFIFO Read Failed");
+        }
+        session->reads++;
+        session->pending += bR;
+        match(session, now_ns());
+    }
+}
+
+void session_close(struct Session *session) {
+    if (session->ring != NULL) {
+        // the server thread sees closed once the ring is empty (if it
+        // misses the wake up, it sees the ring detached by the client)
+        __atomic_store_n(&session->ring->closed, 1, __ATOMIC_SEQ_CST);
+        ring_wake(&session->ring->requestIndex);
+        if (shmdt(session->ring) == -1)
+            errExit("SHMdt failed");
+        session->ring = NULL;
+    }
+    if (close(session->serverFIFO) == -1 || close(session->clientFIFO) == -1 ||
+        close(session->clientFIFO_extra) == -1)
+        errExit("<Client> Close Failed");
+    if (session->lease != -1)
+        fifopool_release(session->pool, session->lease, session->cPid);
+    else if (unlink(session->path2ClientFIFO) != 0)
+        errExit("<Client> 2ClientFIFO Remove Failed");
+    if (session->pool != NULL)
+        fifopool_detach(session->pool);
+}
@@ -0,0 +1,490 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/shm.h>
+
+#include "workers.h"
+#include "ring.h"
+#include "errExit.h"
+
+// the epoll tag of the eventfd of a worker (the other tags are pids)
+#define WAKE_TAG UINT64_MAX
+
+// max events handled by a single epoll_wait
+#define WORKER_EVENTS 64
+
+// the clients served through a ring now and since the start, and their Responses
+static int ringClients;
+static unsigned long ringAccepted, ringServed;
+
+// the thread serving a client through its ring
+struct RingServer {
+    struct Ring *ring;
+    int shmid;
+    int verbose;
+};
+
+static uint64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// wake up a worker waiting in epoll_wait
+static void wake (struct Worker *worker) {
+    uint64_t one = 1;
+    if (write(worker->wakeFD, &one, sizeof(one)) == -1 && errno != EAGAIN)
+        errExit("write eventfd failed");
+}
+
+// open the FIFO of a client without blocking.
+// It returns 0 if the FIFO is open, -1 if it must be opened again later,
+// -2 if the client is gone (its entry was removed)
+static int open_fifo (struct Worker *worker, struct FdEntry *entry, uint64_t now) {
+    // make the path of client's FIFO
+    char path2ClientFIFO [32];
+    if (entry->slot != -1)
+        sprintf(path2ClientFIFO, "%s%d", POOL_FIFO_BASE, entry->slot);
+    else
+        sprintf(path2ClientFIFO, "%s%d", CLIENT_FIFO_BASE, entry->cPid);
+
+    if (worker->verbose)
+        printf("<Server> opening FIFO %s...\n", path2ClientFIFO);
+    // Open the client's FIFO in write-only mode: with O_NONBLOCK the open
+    // fails with ENXIO instead of waiting for the client to open it
+    int fd = open(path2ClientFIFO, O_WRONLY | O_NONBLOCK);
+    if (fd == -1) {
+        if (errno == ENXIO) {
+            entry->backoff = (entry->backoff == 0)? RETRY_MIN_NS :
+                             (entry->backoff * 2 < RETRY_MAX_NS)? entry->backoff * 2 : RETRY_MAX_NS;
+            entry->retryAt = now + entry->backoff;
+            return -1;
+        }
+        if (worker->verbose)
+            printf("<Server> open of %s failed: the responses are lost\n", path2ClientFIFO);
+        fdcache_drop(&worker->cache, entry->cPid);
+        return -2;
+    }
+
+    // the worker is told when a full FIFO has room again
+    struct epoll_event event = {.events = EPOLLOUT | EPOLLET, .data.u64 = (uint64_t) entry->cPid};
+    if (epoll_ctl(worker->epollFD, EPOLL_CTL_ADD, fd, &event) == -1)
+        errExit("epoll_ctl failed");
+    entry->fd = fd;
+    entry->backoff = 0;
+    return 0;
+}
+
+// write the pending Responses of a client, as long as its FIFO takes them.
+// The entry may be removed (the client is gone)
+static void flush (struct Worker *worker, struct FdEntry *entry, uint64_t now) {
+    while (entry->count > 0) {
+        if (entry->fd == -1 && (now < entry->retryAt || open_fifo(worker, entry, now) != 0))
+            return;
+
+        // the Responses of the ring, in at most two pieces: at most
+        // CLIENT_PENDING Responses (< PIPE_BUF bytes), so the write is atomic
+        int first = CLIENT_PENDING - entry->head;
+        if (first > entry->count)
+            first = entry->count;
+        struct iovec iov[2] = {
+            {.iov_base = &entry->pending[entry->head], .iov_len = first * sizeof(struct Response)},
+            {.iov_base = &entry->pending[0], .iov_len = (entry->count - first) * sizeof(struct Response)}
+        };
+        ssize_t bW = writev(entry->fd, iov, (first < entry->count)? 2 : 1);
+        if (bW == -1) {
+            // the FIFO is full: EPOLLOUT will tell when the client made room
+            if (errno == EAGAIN)
+                return;
+            if (errno != EPIPE)
+                errExit("writev failed");
+            // nobody reads the FIFO: the client is gone, or a new client
+            // with the same pid made a new FIFO. The FIFO is opened again
+            if (close(entry->fd) == -1)
+                errExit("close client FIFO failed");
+            entry->fd = -1;
+            entry->retryAt = now;
+            continue;
+        }
+
+        int n = bW / sizeof(struct Response);
+        entry->head = (entry->head + n) % CLIENT_PENDING;
+        entry->count -= n;
+        worker->served += n;
+        // the client is taking its Responses: it is evicted only after
+        // evictMs without progress
+        if (n > 0)
+            entry->since = now;
+    }
+    entry->since = 0;
+}
+
+// answer the Requests of a client through its ring, until the client
+// closes the ring or terminates
+static void *ring_main (void *arg) {
+    struct RingServer *server = arg;
+    struct Ring *ring = server->ring;
+    struct Request requests[RING_SIZE];
+    struct Response responses[RING_SIZE];
+    for (;;) {
+        uint32_t n = ring_pop(&ring->requestIndex, ring->requests, sizeof(struct Request), requests, RING_SIZE);
+        if (n == 0) {
+            if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+                break;
+            // a client terminating without closing its ring is detached
+            if (ring_wait(&ring->requestIndex, (uint64_t) CLIENT_TIMEOUT_MS * 1000000) == -1) {
+                struct shmid_ds ds;
+                if (shmctl(server->shmid, IPC_STAT, &ds) == -1 || ds.shm_nattch < 2)
+                    break;
+            }
+            continue;
+        }
+
+        for (uint32_t i = 0; i < n; ++i) {
+            responses[i].result = requests[i].code * requests[i].code;
+            responses[i].seq = requests[i].seq;
+            responses[i].cPid = requests[i].cPid;
+        }
+        // a session has at most RING_SIZE Requests outstanding: the
+        // Responses wait for room only if the client breaks this rule
+        for (uint32_t done = 0; done < n && !__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE); ) {
+            done += ring_push(&ring->responseIndex, ring->responses, sizeof(struct Response),
+                              responses + done, n - done);
+            if (done < n)
+                sched_yield();
+        }
+        ring_wake(&ring->responseIndex);
+        __atomic_add_fetch(&ringServed, n, __ATOMIC_RELAXED);
+    }
+
+    if (server->verbose)
+        printf("<Server> ring of client %d closed\n", ring->cPid);
+    if (shmdt(ring) == -1)
+        errExit("SHMdt failed");
+    free(server);
+    __atomic_sub_fetch(&ringClients, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// start a thread serving the client of request through its ring (the
+// shmid is in request->seq).
+// It returns 0 if the client is served through the ring, -1 if it must
+// keep using the FIFOs
+static int ring_accept (struct Worker *worker, const struct Request *request) {
+    if (__atomic_add_fetch(&ringClients, 1, __ATOMIC_RELAXED) > RING_MAX_CLIENTS) {
+        __atomic_sub_fetch(&ringClients, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    // the segment must be a whole Ring, made by the client itself: a
+    // smaller one would let ring_main write past its end
+    int shmid = (int) request->seq;
+    struct shmid_ds info;
+    if (shmctl(shmid, IPC_STAT, &info) == -1 || info.shm_segsz < sizeof(struct Ring) ||
+        info.shm_cpid != request->cPid) {
+        __atomic_sub_fetch(&ringClients, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    struct Ring *ring = shmat(shmid, NULL, 0);
+    if (ring == (void *) -1 || ring->cPid != request->cPid) {
+        if (ring != (void *) -1 && shmdt(ring) == -1)
+            errExit("SHMdt failed");
+        __atomic_sub_fetch(&ringClients, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    struct RingServer *server = malloc(sizeof(struct RingServer));
+    if (server == NULL)
+        errExit("malloc failed");
+    server->ring = ring;
+    server->shmid = shmid;
+    server->verbose = worker->verbose;
+    // the thread inherits the signal mask of the worker
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, ring_main, server) != 0)
+        errExit("pthread_create failed");
+    pthread_attr_destroy(&attr);
+    __atomic_add_fetch(&ringAccepted, 1, __ATOMIC_RELAXED);
+    if (worker->verbose)
+        printf("<Server> client %d served through a ring\n", request->cPid);
+    return 0;
+}
+
+// queue the Response of a Request in the entry of its client
+static void respond (struct Worker *worker, const struct Request *request, uint64_t now) {
+    struct FdEntry *entry = fdcache_get(&worker->cache, request->cPid);
+    // a client leasing another FIFO of the pool gave up the former one,
+    // with the Responses still pending for it
+    if (entry != NULL && entry->slot != request->slot) {
+        fdcache_drop(&worker->cache, request->cPid);
+        entry = NULL;
+    }
+    if (entry == NULL)
+        entry = fdcache_put(&worker->cache, request->cPid, request->slot);
+
+    // a batch may hold more Responses for a client than its ring: they are
+    // lost only if its FIFO does not take the ones already queued
+    if (entry->count == CLIENT_PENDING) {
+        flush(worker, entry, now);
+        entry = fdcache_find(&worker->cache, request->cPid);
+        if (entry == NULL || entry->count == CLIENT_PENDING) {
+            worker->lost++;
+            return;
+        }
+    }
+    if (entry->count == 0)
+        entry->since = now;
+    struct Response *response = &entry->pending[(entry->head + entry->count) % CLIENT_PENDING];
+    // the answer to RING_CONNECT goes through the FIFO too
+    response->result = (request->code == RING_CONNECT)? ring_accept(worker, request) :
+                       request->code * request->code;
+    response->seq = request->seq;
+    response->cPid = request->cPid;
+    entry->count++;
+}
+
+// open again the FIFOs not open yet, and evict the clients that did not take
+// any Response for evictMs.
+// It returns the milliseconds until the next deadline, -1 if there is none
+static int check_clients (struct Worker *worker, uint64_t now) {
+    uint64_t evictNs = (uint64_t) worker->evictMs * 1000000, next = UINT64_MAX;
+    struct FdCache *cache = &worker->cache;
+
+    // a removed entry is replaced by the last one: scanning backwards,
+    // the moved entry was already checked
+    for (int e = cache->used - 1; e >= 0; --e) {
+        struct FdEntry *entry = &cache->entries[e];
+        if (entry->count == 0)
+            continue;
+        pid_t cPid = entry->cPid;
+        if (now - entry->since >= evictNs) {
+            if (worker->verbose)
+                printf("<Server> client %d evicted: %d responses lost\n", cPid, entry->count);
+            worker->evicted++;
+            fdcache_drop(cache, cPid);
+            continue;
+        }
+        if (entry->fd == -1 && now >= entry->retryAt) {
+            flush(worker, entry, now);
+            if (e >= cache->used || cache->entries[e].cPid != cPid || entry->count == 0)
+                continue;
+        }
+
+        uint64_t deadline = entry->since + evictNs;
+        if (entry->fd == -1 && entry->retryAt < deadline)
+            deadline = entry->retryAt;
+        if (deadline < next)
+            next = deadline;
+    }
+    if (next == UINT64_MAX)
+        return -1;
+    return (next > now)? (int) ((next - now + 999999) / 1000000) : 0;
+}
+
+// take all the queued Requests.
+// It returns their number, and sets *closed if no more Requests will come
+static int take (struct Worker *worker, struct Request *requests, int *closed) {
+    pthread_mutex_lock(&worker->lock);
+    int n = worker->count;
+    for (int i = 0; i < n; ++i)
+        requests[i] = worker->queue[(worker->head + i) % WORKER_QUEUE];
+    worker->head = (worker->head + n) % WORKER_QUEUE;
+    worker->count = 0;
+    *closed = worker->closed;
+    pthread_cond_signal(&worker->changed);
+    pthread_mutex_unlock(&worker->lock);
+    return n;
+}
+
+static void *worker_main (void *arg) {
+    struct Worker *worker = arg;
+    struct Request requests[WORKER_QUEUE];
+    struct epoll_event events[WORKER_EVENTS];
+    int timeoutMs = -1, closed = 0;
+    for (;;) {
+        int nEvents = epoll_wait(worker->epollFD, events, WORKER_EVENTS, timeoutMs);
+        if (nEvents == -1) {
+            if (errno != EINTR)
+                errExit("epoll_wait failed");
+            nEvents = 0;
+        }
+
+        uint64_t now = now_ns();
+        for (int i = 0; i < nEvents; ++i) {
+            if (events[i].data.u64 == WAKE_TAG) {
+                uint64_t value;
+                if (read(worker->wakeFD, &value, sizeof(value)) == -1 && errno != EAGAIN)
+                    errExit("read eventfd failed");
+
+                // the Responses of a batch are queued first, so that all
+                // the Responses of a client are written together
+                int n = take(worker, requests, &closed);
+                for (int k = 0; k < n; ++k)
+                    respond(worker, &requests[k], now);
+                for (int k = 0; k < n; ++k) {
+                    struct FdEntry *entry = fdcache_find(&worker->cache, requests[k].cPid);
+                    if (entry != NULL && entry->count > 0)
+                        flush(worker, entry, now);
+                }
+            } else {
+                // a full FIFO has room again
+                struct FdEntry *entry = fdcache_find(&worker->cache, (pid_t) events[i].data.u64);
+                if (entry != NULL && entry->fd != -1)
+                    flush(worker, entry, now);
+            }
+        }
+
+        timeoutMs = check_clients(worker, now_ns());
+        // at the end, the pending Responses are written or their clients evicted
+        if (closed && timeoutMs == -1)
+            break;
+    }
+    return NULL;
+}
+
+void pool_start(struct WorkerPool *pool, int nWorkers, int cacheSize, int evictMs, int verbose) {
+    pool->nWorkers = nWorkers;
+    pool->workers = calloc(nWorkers, sizeof(struct Worker));
+    pool->first = malloc((nWorkers + 1) * sizeof(size_t));
+    if (pool->workers == NULL || pool->first == NULL)
+        errExit("calloc failed");
+    pool->order = NULL;
+    pool->orderCapacity = 0;
+
+    // the signals are handled by the thread reading the server FIFO,
+    // and a client closing its FIFO must not kill the server
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < nWorkers; ++i) {
+        struct Worker *worker = &pool->workers[i];
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->changed, NULL);
+        fdcache_init(&worker->cache, cacheSize);
+        worker->verbose = verbose;
+        worker->evictMs = evictMs;
+
+        worker->wakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        worker->epollFD = epoll_create1(EPOLL_CLOEXEC);
+        if (worker->wakeFD == -1 || worker->epollFD == -1)
+            errExit("eventfd/epoll_create1 failed");
+        struct epoll_event event = {.events = EPOLLIN, .data.u64 = WAKE_TAG};
+        if (epoll_ctl(worker->epollFD, EPOLL_CTL_ADD, worker->wakeFD, &event) == -1)
+            errExit("epoll_ctl failed");
+
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0)
+            errExit("pthread_create failed");
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+static int worker_of (const struct WorkerPool *pool, const struct Request *request) {
+    return (int) ((unsigned) request->cPid % pool->nWorkers);
+}
+
+// queue a Request for a worker whose lock is held.
+// If the queue is full, the worker is woken up to take the Requests queued so far
+static void enqueue (struct Worker *worker, const struct Request *request) {
+    while (worker->count == WORKER_QUEUE) {
+        wake(worker);
+        pthread_cond_wait(&worker->changed, &worker->lock);
+    }
+    worker->queue[(worker->head + worker->count) % WORKER_QUEUE] = *request;
+    worker->count++;
+}
+
+void pool_dispatch_batch(struct WorkerPool *pool, const struct Request *requests, size_t n) {
+    // sort the Requests by worker (a counting sort keeping the order of
+    // arrival), then lock each queue once
+    if (n > pool->orderCapacity) {
+        pool->order = realloc(pool->order, n * sizeof(size_t));
+        if (pool->order == NULL)
+            errExit("realloc failed");
+        pool->orderCapacity = n;
+    }
+    size_t *first = pool->first;
+    for (int w = 0; w <= pool->nWorkers; ++w)
+        first[w] = 0;
+    for (size_t i = 0; i < n; ++i)
+        first[worker_of(pool, &requests[i]) + 1]++;
+    for (int w = 0; w < pool->nWorkers; ++w)
+        first[w + 1] += first[w];
+    for (size_t i = 0; i < n; ++i)
+        pool->order[first[worker_of(pool, &requests[i])]++] = i;
+
+    // now first[w] is the end of the Requests of worker w
+    size_t begin = 0;
+    for (int w = 0; w < pool->nWorkers; ++w) {
+        if (first[w] == begin)
+            continue;
+        struct Worker *worker = &pool->workers[w];
+        pthread_mutex_lock(&worker->lock);
+        for (size_t k = begin; k < first[w]; ++k)
+            enqueue(worker, &requests[pool->order[k]]);
+        pthread_mutex_unlock(&worker->lock);
+        wake(worker);
+        begin = first[w];
+    }
+}
+
+void pool_stop(struct WorkerPool *pool) {
+    for (int i = 0; i < pool->nWorkers; ++i) {
+        struct Worker *worker = &pool->workers[i];
+        pthread_mutex_lock(&worker->lock);
+        worker->closed = 1;
+        pthread_mutex_unlock(&worker->lock);
+        wake(worker);
+    }
+    for (int i = 0; i < pool->nWorkers; ++i) {
+        struct Worker *worker = &pool->workers[i];
+        if (pthread_join(worker->thread, NULL) != 0)
+            errExit("pthread_join failed");
+        fdcache_free(&worker->cache);
+        if (close(worker->wakeFD) == -1 || close(worker->epollFD) == -1)
+            errExit("close failed");
+        pthread_mutex_destroy(&worker->lock);
+        pthread_cond_destroy(&worker->changed);
+    }
+    free(pool->order);
+    free(pool->first);
+    pool->order = pool->first = NULL;
+}
+
+void pool_report(const struct WorkerPool *pool) {
+    unsigned long served = 0, lost = 0, evicted = 0;
+    for (int i = 0; i < pool->nWorkers; ++i) {
+        const struct Worker *worker = &pool->workers[i];
+        // the Responses of the removed entries are lost too
+        unsigned long workerLost = worker->lost + worker->cache.discarded;
+        printf("<Server> worker %d: %lu responses, %lu lost, %lu clients evicted, cache %lu hits %lu misses %lu evictions\n",
+               i, worker->served, workerLost, worker->evicted, worker->cache.hits,
+               worker->cache.misses, worker->cache.evictions);
+        served += worker->served;
+        lost += workerLost;
+        evicted += worker->evicted;
+    }
+    printf("<Server> %lu responses sent, %lu lost, %lu clients evicted\n", served, lost, evicted);
+    if (ringAccepted > 0)
+        printf("<Server> %lu responses through the rings of %lu clients\n",
+               __atomic_load_n(&ringServed, __ATOMIC_RELAXED), ringAccepted);
+}
+
+int default_workers(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return WORKERS_PER_CORE * ((cores > 0)? (int) cores : 1);
+}
@@ -1,6 +1,13 @@
 #ifndef _CONSUMER_HH
 #define _CONSUMER_HH
 
-void consumer (int *pipeFD);
+#include "transfer.h"
+#include "writer.h"
+
+// outFD is the descriptor where the consumer drains the pipe.
+// If outFD is -1 and mode is TRANSFER_RW, the consumer prints the lines on terminal.
+// If output->countOnly is set, the consumer only counts the received bytes
+void consumer (int *pipeFD, enum TransferMode mode, int outFD,
+               const struct OutputConfig *output);
 
 #endif
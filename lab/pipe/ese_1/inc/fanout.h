@@ -0,0 +1,47 @@
+#ifndef _FANOUT_HH
+#define _FANOUT_HH
+
+#include <sys/types.h>
+
+// max number of bytes duplicated to the consumers at once
+#define FANOUT_CHUNK 65536
+
+// default milliseconds a consumer pipe may stay full before the consumer
+// is dropped (SLOW_DROP)
+#define FANOUT_DROP_MS 200
+
+// what the fan-out does when a consumer pipe is full:
+// SLOW_BLOCK waits for the consumer, stopping the stream for all of them,
+// SLOW_DROP closes the pipe of the consumer and goes on with the others
+enum SlowPolicy {
+    SLOW_BLOCK,
+    SLOW_DROP
+};
+
+// A FanoutSink is the pipe of a downstream consumer, with its statistics
+struct FanoutSink {
+    int fd;                     /* write end of the consumer pipe         */
+    int active;                 /* 0: dropped or closed                   */
+    const char *reason;         /* why the consumer was dropped           */
+    unsigned long long bytes;   /* bytes delivered                        */
+    unsigned long stalls;       /* chunks not accepted at once            */
+    double elapsed;             /* seconds until the last delivery        */
+};
+
+// The parse_slow_policy method converts "block" or "drop" into a SlowPolicy.
+// It returns -1 if name is not a known policy
+int parse_slow_policy(const char *name, enum SlowPolicy *policy);
+
+// The fanout method duplicates everything read from the pipe inFD into the
+// pipes of the nSinks sinks, with tee(2) and splice(2): the bytes never
+// go through user space. A sink that does not accept a chunk for dropMs
+// milliseconds is dropped if policy is SLOW_DROP. The pipes of the sinks
+// are closed at the end of the stream.
+// It returns the number of bytes read from inFD, otherwise it terminates the calling process
+ssize_t fanout(int inFD, struct FanoutSink *sinks, int nSinks,
+               enum SlowPolicy policy, int dropMs);
+
+// The fanout_report method prints the throughput of each sink
+void fanout_report(const struct FanoutSink *sinks, int nSinks);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef _LINEBUF_HH
+#define _LINEBUF_HH
+
+#include <stddef.h>
+
+// the callback receiving each whole line (without the '\n')
+typedef void (*line_callback)(const char *line, size_t len, void *arg);
+
+// A LineBuffer rebuilds the lines of a byte stream read in chunks:
+// the partial line at the end of a chunk is kept, and completed by the next ones
+struct LineBuffer {
+    char *partial;          /* the incomplete line of the previous chunks */
+    size_t len;             /* bytes in partial                          */
+    size_t capacity;        /* size of partial                           */
+    unsigned long lines;    /* number of emitted lines                   */
+    line_callback callback;
+    void *arg;              /* passed to callback                        */
+};
+
+// The find_newline method returns a pointer to the first '\n' of the n bytes
+// starting at p, or NULL if there is none. It uses an AVX2 or SSE2 kernel
+// if the CPU supports it, otherwise a scalar loop
+const char *find_newline(const char *p, size_t n);
+
+// The newline_kernel method returns the name of the kernel used by find_newline
+const char *newline_kernel(void);
+
+// The linebuf_init method prepares an empty LineBuffer, emitting the lines to callback
+void linebuf_init(struct LineBuffer *lb, line_callback callback, void *arg);
+
+// The linebuf_feed method scans n bytes of the stream, and emits each line
+// completed by them. The bytes after the last '\n' are kept for the next call.
+// It terminates the calling process if the partial line can not be stored
+void linebuf_feed(struct LineBuffer *lb, const char *data, size_t n);
+
+// The linebuf_finish method emits the last line, if the stream does not end with '\n'
+void linebuf_finish(struct LineBuffer *lb);
+
+// The linebuf_free method releases the memory of the LineBuffer
+void linebuf_free(struct LineBuffer *lb);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef _PRODUCER_HH
 #define _PRODUCER_HH
 
-void producer (int *pipeFD, const char *filename);
+#include "transfer.h"
+
+void producer (int *pipeFD, const char *filename, enum TransferMode mode);
 
 #endif
@@ -0,0 +1,32 @@
+#ifndef _TRANSFER_HH
+#define _TRANSFER_HH
+
+#include <sys/types.h>
+
+// the transfer modes that can be selected from the command line:
+// TRANSFER_RW copies the bytes through a user space buffer (read + write),
+// TRANSFER_SPLICE moves the pages between the two descriptors with splice(2),
+// TRANSFER_URING keeps many reads in flight with io_uring (see uring.h)
+enum TransferMode {
+    TRANSFER_RW,
+    TRANSFER_SPLICE,
+    TRANSFER_URING
+};
+
+// The parse_transfer_mode method converts "rw", "splice" or "uring" into a TransferMode.
+// It returns -1 if name is not a known transfer mode
+int parse_transfer_mode(const char *name, enum TransferMode *mode);
+
+// The copy_all method copies all the bytes from inFD to outFD, chunkSize
+// bytes at a time, with a read and a write for each chunk.
+// It returns the number of copied bytes, otherwise it terminates the calling process
+ssize_t copy_all(int inFD, int outFD, size_t chunkSize);
+
+// The splice_all method moves all the bytes from inFD to outFD with splice(2).
+// One of the two descriptors must be a pipe. If the kernel does not allow
+// splice between the two descriptors (e.g. outFD is a terminal), it falls
+// back to copy_all for the remaining bytes.
+// It returns the number of moved bytes, otherwise it terminates the calling process
+ssize_t splice_all(int inFD, int outFD);
+
+#endif
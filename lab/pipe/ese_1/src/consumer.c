@@ -1,31 +1,100 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "consumer.h"
+#include "linebuf.h"
+#include "writer.h"
 #include "errExit.h"
 
 #define MSG_BYTES 100
 
-void consumer (int *pipeFD) {
+// bytes read from the pipe at once when the lines are rebuilt
+#define READ_BYTES 65536
+
+static const char linePrefix[] = "<Consumer> line: ";
+
+// print a whole line on terminal: prefix, line and '\n' are gathered by
+// the Writer, and written with a single writev for many lines
+static void print_line (const char *line, size_t len, void *arg) {
+    struct Writer *writer = arg;
+    writer_add_const(writer, linePrefix, sizeof(linePrefix) - 1);
+    writer_add(writer, line, len);
+    writer_add_const(writer, "\n", 1);
+}
+
+static double elapsed_since (const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void consumer (int *pipeFD, enum TransferMode mode, int outFD,
+               const struct OutputConfig *output) {
     // close pipe's write end
     if ((close(pipeFD[1])) == -1)
 	errExit("chiuso consumatore  - scrittura");
 
-    ssize_t rB = -1;
-    char buffer[MSG_BYTES + 1];
-    do {
-        // read max MSG_BYTES chars from the pipe
-        rB = read(pipeFD[0], buffer, MSG_BYTES);
+    if (output->countOnly) {
+        // benchmark the transport alone: read and count, without any output
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        static char buffer[READ_BYTES];
+        unsigned long long bytes = 0;
+        unsigned long chunks = 0;
+        ssize_t rB;
+        while ((rB = read(pipeFD[0], buffer, READ_BYTES)) > 0) {
+            bytes += rB;
+            chunks++;
+        }
         if (rB == -1)
             printf("<Consumer> it looks like the pipe is broken\n");
-        else if (!rB)
+
+        double elapsed = elapsed_since(&start);
+        printf("<Consumer> %llu bytes, %lu chunks in %.3f s (%.1f MB/s)\n",
+               bytes, chunks, elapsed, (elapsed > 0)? bytes / elapsed / 1e6 : 0);
+    } else if (mode == TRANSFER_SPLICE) {
+        // drain the pipe into outFD without copying the bytes in user space
+        // (stdout is flushed first, so that our messages are not mixed with data)
+        fflush(stdout);
+        ssize_t bS = splice_all(pipeFD[0], (outFD == -1)? STDOUT_FILENO : outFD);
+        fprintf(stderr, "<Consumer> %zd bytes drained with splice\n", bS);
+    } else if (outFD != -1) {
+        // drain the pipe into outFD with read/write
+        ssize_t bC = copy_all(pipeFD[0], outFD, MSG_BYTES);
+        printf("<Consumer> %zd bytes copied\n", bC);
+    } else {
+        // the chunks do not respect the lines of the file: a LineBuffer
+        // keeps the partial line at the end of a chunk until its '\n' arrives
+        fflush(stdout);
+        struct Writer writer;
+        writer_init(&writer, STDOUT_FILENO, output);
+        struct LineBuffer lb;
+        linebuf_init(&lb, print_line, &writer);
+
+        ssize_t rB = -1;
+        static char buffer[READ_BYTES];
+        do {
+            // read max READ_BYTES chars from the pipe
+            rB = read(pipeFD[0], buffer, READ_BYTES);
+            if (rB > 0)
+                linebuf_feed(&lb, buffer, rB);
+        } while (rB > 0);
+
+        // the last line may not end with '\n'
+        linebuf_finish(&lb);
+        writer_free(&writer);
+
+        if (rB == -1)
+            printf("<Consumer> it looks like the pipe is broken\n");
+        else
             printf("<Consumer> it looks like all pipe's write ends were closed\n");
-        else {
-            buffer[rB] = '\0';
-            printf("<Consumer> line: %s\n", buffer);
-        }
-    } while (rB > 0);
+        printf("<Consumer> %lu lines (%s newline scan), %lu writes\n",
+               lb.lines, newline_kernel(), writer.writes);
+        linebuf_free(&lb);
+    }
 
     // close pipe's read end
     if ((close(pipeFD[0])) == -1)
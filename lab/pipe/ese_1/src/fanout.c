@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include "fanout.h"
+#include "errExit.h"
+
+// the state shared by the helpers of fanout
+struct Fanout {
+    int inFD;
+    int scratch[2];             /* a private pipe for partial deliveries  */
+    int devNull;                /* where the consumed bytes are spliced   */
+    enum SlowPolicy policy;
+    int dropMs;
+    struct timespec start;
+};
+
+int parse_slow_policy(const char *name, enum SlowPolicy *policy) {
+    if (strcmp(name, "block") == 0)
+        *policy = SLOW_BLOCK;
+    else if (strcmp(name, "drop") == 0)
+        *policy = SLOW_DROP;
+    else
+        return -1;
+    return 0;
+}
+
+static double elapsed_since (const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// throw away n bytes at the head of the pipe fd, splicing them to /dev/null
+static void discard (struct Fanout *f, int fd, size_t n) {
+    while (n > 0) {
+        ssize_t bS = splice(fd, NULL, f->devNull, NULL, n, SPLICE_F_MOVE);
+        if (bS == -1 && errno == EINTR)
+            continue;
+        if (bS <= 0)
+            errExit("splice to /dev/null failed");
+        n -= bS;
+    }
+}
+
+// wait until the pipe fd has room, for at most timeoutMs (-1: forever).
+// It returns 0 on timeout, otherwise 1 (also if the consumer closed its pipe:
+// the next write reports EPIPE)
+static int wait_room (int fd, int timeoutMs) {
+    struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+    int ready;
+    while ((ready = poll(&pfd, 1, timeoutMs)) == -1) {
+        if (errno != EINTR)
+            errExit("poll failed");
+    }
+    return ready;
+}
+
+static void drop (struct Fanout *f, struct FanoutSink *sink, int index, const char *reason) {
+    sink->active = 0;
+    sink->reason = reason;
+    sink->elapsed = elapsed_since(&f->start);
+    if (close(sink->fd) == -1)
+        errExit("close consumer pipe failed");
+    fprintf(stderr, "<Fanout> consumer %d dropped after %llu bytes: %s\n",
+            index, sink->bytes, reason);
+}
+
+// deliver the chunk bytes at the head of the input pipe to a sink,
+// without consuming them.
+// It returns 0 if the sink got the whole chunk, -1 if it was dropped
+static int deliver (struct Fanout *f, struct FanoutSink *sink, int index, size_t chunk) {
+    int timeoutMs = (f->policy == SLOW_BLOCK)? -1 : f->dropMs;
+
+    // tee stops when the consumer pipe is full: usually it takes everything
+    ssize_t done = tee(f->inFD, sink->fd, chunk, SPLICE_F_NONBLOCK);
+    if (done == -1) {
+        if (errno == EPIPE) {
+            drop(f, sink, index, "it closed its pipe");
+            return -1;
+        }
+        if (errno != EAGAIN && errno != EINTR)
+            errExit("tee failed");
+        done = 0;
+    }
+
+    if ((size_t) done < chunk) {
+        // tee always starts from the head of the input pipe: the rest of the
+        // chunk is duplicated in the (empty) scratch pipe, whose pages are
+        // then moved to the consumer as soon as it makes room
+        sink->stalls++;
+        ssize_t bT = tee(f->inFD, f->scratch[1], chunk, 0);
+        if (bT != (ssize_t) chunk)
+            errExit("tee to the scratch pipe failed");
+        discard(f, f->scratch[0], done);
+
+        size_t rest = chunk - done;
+        while (rest > 0) {
+            ssize_t bS = splice(f->scratch[0], NULL, sink->fd, NULL, rest,
+                                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (bS > 0) {
+                rest -= bS;
+                continue;
+            }
+            const char *reason = NULL;
+            if (errno == EPIPE)
+                reason = "it closed its pipe";
+            else if (errno != EAGAIN && errno != EINTR)
+                errExit("splice to consumer failed");
+            else if (!wait_room(sink->fd, timeoutMs))
+                reason = "its pipe stayed full";
+            if (reason != NULL) {
+                discard(f, f->scratch[0], rest);
+                sink->bytes += chunk - rest;
+                drop(f, sink, index, reason);
+                return -1;
+            }
+        }
+    }
+
+    sink->bytes += chunk;
+    sink->elapsed = elapsed_since(&f->start);
+    return 0;
+}
+
+ssize_t fanout(int inFD, struct FanoutSink *sinks, int nSinks,
+               enum SlowPolicy policy, int dropMs) {
+    struct Fanout f = {.inFD = inFD, .policy = policy, .dropMs = dropMs};
+    clock_gettime(CLOCK_MONOTONIC, &f.start);
+
+    // a dropped consumer must not kill the fan-out: its pipe returns EPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    // the scratch pipe holds at least as many pages as the input pipe,
+    // so that a chunk always fits in it
+    if (pipe(f.scratch) == -1)
+        errExit("pipe failed");
+    int inSize = fcntl(inFD, F_GETPIPE_SZ);
+    if (inSize == -1 || fcntl(f.scratch[1], F_SETPIPE_SZ, inSize) == -1)
+        errExit("fcntl F_SETPIPE_SZ failed");
+    if ((f.devNull = open("/dev/null", O_WRONLY)) == -1)
+        errExit("open /dev/null failed");
+
+    for (int i = 0; i < nSinks; ++i) {
+        sinks[i].active = 1;
+        sinks[i].reason = NULL;
+        sinks[i].bytes = 0;
+        sinks[i].stalls = 0;
+        sinks[i].elapsed = 0;
+    }
+
+    ssize_t total = 0;
+    for (;;) {
+        // wait for the producer: at the end of the stream the pipe is
+        // readable and empty
+        struct pollfd pfd = {.fd = inFD, .events = POLLIN};
+        if (poll(&pfd, 1, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            errExit("poll failed");
+        }
+        int available;
+        if (ioctl(inFD, FIONREAD, &available) == -1)
+            errExit("ioctl FIONREAD failed");
+        if (available == 0) {
+            if (pfd.revents & POLLHUP)
+                break;
+            continue;
+        }
+
+        // each consumer gets the chunk, then the chunk is consumed.
+        // When all the consumers are dropped the stream is still drained,
+        // so that the producer can finish
+        size_t chunk = (available < FANOUT_CHUNK)? (size_t) available : FANOUT_CHUNK;
+        for (int i = 0; i < nSinks; ++i)
+            if (sinks[i].active)
+                deliver(&f, &sinks[i], i, chunk);
+        discard(&f, inFD, chunk);
+        total += chunk;
+    }
+
+    // the consumers still connected see the end of the stream
+    for (int i = 0; i < nSinks; ++i)
+        if (sinks[i].active && close(sinks[i].fd) == -1)
+            errExit("close consumer pipe failed");
+    if (close(f.scratch[0]) == -1 || close(f.scratch[1]) == -1 || close(f.devNull) == -1)
+        errExit("close failed");
+    return total;
+}
+
+void fanout_report(const struct FanoutSink *sinks, int nSinks) {
+    for (int i = 0; i < nSinks; ++i) {
+        const struct FanoutSink *sink = &sinks[i];
+        fprintf(stderr, "<Fanout> consumer %d: %llu bytes in %.3f s (%.1f MB/s), %lu stalls%s%s\n",
+                i, sink->bytes, sink->elapsed,
+                (sink->elapsed > 0)? sink->bytes / sink->elapsed / 1e6 : 0,
+                sink->stalls, (sink->reason != NULL)? ", dropped: " : "",
+                (sink->reason != NULL)? sink->reason : "");
+    }
+}
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+#include "linebuf.h"
+#include "errExit.h"
+
+static const char *find_newline_scalar(const char *p, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        if (p[i] == '\n')
+            return p + i;
+    return NULL;
+}
+
+#ifdef HAVE_X86_SIMD
+// compare 16 bytes at a time with '\n': the mask has a bit set for each match
+__attribute__((target("sse2")))
+static const char *find_newline_sse2(const char *p, size_t n) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (p + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+        if (mask != 0)
+            return p + i + __builtin_ctz(mask);
+    }
+    return find_newline_scalar(p + i, n - i);
+}
+
+// compare 64 bytes (two 32 bytes registers) at a time with '\n'
+__attribute__((target("avx2")))
+static const char *find_newline_avx2(const char *p, size_t n) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *) (p + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i *) (p + i + 32));
+        __m256i any = _mm256_or_si256(_mm256_cmpeq_epi8(lo, nl), _mm256_cmpeq_epi8(hi, nl));
+        if (!_mm256_testz_si256(any, any)) {
+            unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, nl));
+            if (mask != 0)
+                return p + i + __builtin_ctz(mask);
+            mask = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, nl));
+            return p + i + 32 + __builtin_ctz(mask);
+        }
+    }
+    for (; i + 32 <= n; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (p + i));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl));
+        if (mask != 0)
+            return p + i + __builtin_ctz(mask);
+    }
+    return find_newline_sse2(p + i, n - i);
+}
+#endif
+
+// the kernel is chosen once, the first time find_newline is called
+static const char *(*kernel)(const char *, size_t) = NULL;
+static const char *kernelName = "scalar";
+
+static void select_kernel(void) {
+    kernel = find_newline_scalar;
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = find_newline_avx2;
+        kernelName = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernel = find_newline_sse2;
+        kernelName = "sse2";
+    }
+#endif
+}
+
+const char *find_newline(const char *p, size_t n) {
+    if (kernel == NULL)
+        select_kernel();
+    return kernel(p, n);
+}
+
+const char *newline_kernel(void) {
+    if (kernel == NULL)
+        select_kernel();
+    return kernelName;
+}
+
+void linebuf_init(struct LineBuffer *lb, line_callback callback, void *arg) {
+    lb->partial = NULL;
+    lb->len = 0;
+    lb->capacity = 0;
+    lb->lines = 0;
+    lb->callback = callback;
+    lb->arg = arg;
+}
+
+// append n bytes to the partial line
+static void append_partial(struct LineBuffer *lb, const char *data, size_t n) {
+    if (lb->len + n > lb->capacity) {
+        size_t capacity = (lb->capacity == 0)? 256 : lb->capacity;
+        while (capacity < lb->len + n)
+            capacity *= 2;
+        char *partial = realloc(lb->partial, capacity);
+        if (partial == NULL)
+            errExit("realloc failed");
+        lb->partial = partial;
+        lb->capacity = capacity;
+    }
+    memcpy(lb->partial + lb->len, data, n);
+    lb->len += n;
+}
+
+static void emit(struct LineBuffer *lb, const char *line, size_t len) {
+    lb->callback(line, len, lb->arg);
+    lb->lines++;
+}
+
+void linebuf_feed(struct LineBuffer *lb, const char *data, size_t n) {
+    const char *end = data + n;
+    const char *nl = find_newline(data, n);
+    if (nl == NULL) {
+        append_partial(lb, data, n);
+        return;
+    }
+
+    // the first '\n' completes the line started by the previous chunks
+    if (lb->len > 0) {
+        append_partial(lb, data, nl - data);
+        emit(lb, lb->partial, lb->len);
+        lb->len = 0;
+    } else
+        emit(lb, data, nl - data);
+
+    // the other lines are emitted straight from the chunk, without copies
+    const char *line = nl + 1;
+    while ((nl = find_newline(line, end - line)) != NULL) {
+        emit(lb, line, nl - line);
+        line = nl + 1;
+    }
+
+    // keep the beginning of the next line
+    if (line < end)
+        append_partial(lb, line, end - line);
+}
+
+void linebuf_finish(struct LineBuffer *lb) {
+    if (lb->len > 0) {
+        emit(lb, lb->partial, lb->len);
+        lb->len = 0;
+    }
+}
+
+void linebuf_free(struct LineBuffer *lb) {
+    free(lb->partial);
+    lb->partial = NULL;
+    lb->capacity = 0;
+}
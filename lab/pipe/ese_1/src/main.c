@@ -1,39 +1,194 @@
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/wait.h>
 
 #include "consumer.h"
+#include "fanout.h"
 #include "producer.h"
+#include "transfer.h"
 #include "errExit.h"
 
+static void usage (const char *prog) {
+    printf("Usage: %s [-m rw|splice|uring] [-n consumers] [--slow block|drop] [--drop-ms MS]\n"
+           "          [--count-only] [--flush-bytes N] [--flush-count N] textFile [outFile]\n", prog);
+    printf("  -m             transfer mode: read/write (default), splice or io_uring\n");
+    printf("  -n             consumers receiving the whole stream (default 1);\n"
+           "                 consumer i writes to outFile.i\n");
+    printf("  --slow         with many consumers, a full consumer pipe blocks the stream\n"
+           "                 (default) or the consumer is dropped\n");
+    printf("  --drop-ms      milliseconds a pipe may stay full before its consumer is dropped (default %d)\n",
+           FANOUT_DROP_MS);
+    printf("  --count-only   no output: only report bytes, chunks and elapsed time\n");
+    printf("  --flush-bytes  write the lines when so many bytes are pending\n");
+    printf("  --flush-count  write the lines when so many slices are pending\n");
+}
+
+// capacity requested for the pipe in splice mode:
+// a bigger pipe lets a single splice call move more pages
+#define SPLICE_PIPE_SIZE (1024 * 1024)
+
+// broadcast the pipe of the producer to nConsumers consumer processes:
+// this process runs the fan-out between the producer pipe and the pipes
+// of the consumers, then reports the throughput of each consumer
+static void broadcast (int *pipeFD, int nConsumers, enum TransferMode mode,
+                       const char *outFile, const struct OutputConfig *output,
+                       enum SlowPolicy policy, int dropMs) {
+    struct FanoutSink sinks[nConsumers];
+    for (int i = 0; i < nConsumers; ++i) {
+        int sinkFD[2];
+        if (pipe(sinkFD) == -1)
+            errExit("pipe failed");
+        if (mode == TRANSFER_SPLICE)
+            fcntl(sinkFD[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+
+        // flush before fork, or the child would print our messages again
+        fflush(stdout);
+        switch (fork()) {
+            case -1:
+                errExit("fork failed");
+                break;
+            case 0: {
+                // the consumer keeps only the read end of its own pipe
+                if (close(pipeFD[0]) == -1)
+                    errExit("close failed");
+                for (int j = 0; j < i; ++j)
+                    if (close(sinks[j].fd) == -1)
+                        errExit("close failed");
+
+                int outFD = -1;
+                if (outFile != NULL) {
+                    char name[strlen(outFile) + 16];
+                    snprintf(name, sizeof(name), "%s.%d", outFile, i);
+                    outFD = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                    if (outFD == -1)
+                        errExit("open output file failed");
+                }
+                consumer(sinkFD, mode, outFD, output);
+                if (outFD != -1 && close(outFD) == -1)
+                    errExit("close output file failed");
+                fflush(stdout);
+                _exit(0);
+            }
+            default:
+                if (close(sinkFD[0]) == -1)
+                    errExit("close failed");
+                sinks[i].fd = sinkFD[1];
+        }
+    }
+
+    ssize_t total = fanout(pipeFD[0], sinks, nConsumers, policy, dropMs);
+    if (close(pipeFD[0]) == -1)
+        errExit("close failed");
+
+    // the report follows the messages of the producer and of the consumers
+    while (wait(NULL) != -1)
+        ;
+    fprintf(stderr, "<Fanout> %zd bytes broadcast to %d consumers\n", total, nConsumers);
+    fanout_report(sinks, nConsumers);
+}
+
 int main (int argc, char *argv[]) {
 
     // Check command line input arguments.
-    // The program only wants a text file
-    if (argc != 2) {
-        printf("Usage: %s textFile\n", argv[0]);
+    // The program wants a text file, and optionally an output file
+    // and the transfer mode (rw, splice or uring)
+    enum TransferMode mode = TRANSFER_RW;
+    enum SlowPolicy policy = SLOW_BLOCK;
+    int nConsumers = 1, dropMs = FANOUT_DROP_MS;
+    struct OutputConfig output = {
+        .countOnly = 0, .flushBytes = FLUSH_BYTES, .flushCount = FLUSH_COUNT
+    };
+    const struct option longOptions[] = {
+        {"count-only",  no_argument,       NULL, 'C'},
+        {"flush-bytes", required_argument, NULL, 'B'},
+        {"flush-count", required_argument, NULL, 'N'},
+        {"slow",        required_argument, NULL, 'S'},
+        {"drop-ms",     required_argument, NULL, 'D'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:n:", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'm':
+                if (parse_transfer_mode(optarg, &mode) == -1) {
+                    usage(argv[0]);
+                    return 0;
+                }
+                break;
+            case 'S':
+                if (parse_slow_policy(optarg, &policy) == -1) {
+                    usage(argv[0]);
+                    return 0;
+                }
+                break;
+            case 'n': nConsumers = atoi(optarg); break;
+            case 'D': dropMs = atoi(optarg); break;
+            case 'C': output.countOnly = 1; break;
+            case 'B': output.flushBytes = strtoul(optarg, NULL, 10); break;
+            case 'N': output.flushCount = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 0;
+        }
+    }
+
+    if ((argc - optind != 1 && argc - optind != 2) ||
+        output.flushBytes == 0 || output.flushCount <= 0 ||
+        nConsumers <= 0 || dropMs < 0) {
+        usage(argv[0]);
         return 0;
     }
 
+    // open the output file, if any
+    // (with many consumers, each consumer opens its own)
+    int outFD = -1;
+    if (argc - optind == 2 && nConsumers == 1) {
+        outFD = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (outFD == -1)
+            errExit("open output file failed");
+    }
+
     int pipeFD[2];
 
     // Make a new PIPE
     if((pipe(pipeFD)) == -1)
 	errExit("pipe failed");
 
+    // a bigger pipe lets splice move more pages per call.
+    // If the kernel refuses, we keep the default capacity
+    if (mode == TRANSFER_SPLICE)
+        fcntl(pipeFD[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
 
     // Generate a sub process reading a text file token-by-token
-    printf("<Consumer> making a subprocess\n");
+    fprintf((mode == TRANSFER_SPLICE)? stderr : stdout,
+            "<Consumer> making a subprocess\n");
     switch (fork()) {
         case -1:
             errExit("fork failed");
         case 0: {
-            producer(pipeFD, argv[1]);
+            producer(pipeFD, argv[optind], mode);
             _exit(0);
         }
         default: {
-            consumer(pipeFD);
+            if (nConsumers == 1)
+                consumer(pipeFD, mode, outFD, &output);
+            else {
+                if (close(pipeFD[1]) == -1)
+                    errExit("close failed");
+                broadcast(pipeFD, nConsumers, mode,
+                          (argc - optind == 2)? argv[optind + 1] : NULL,
+                          &output, policy, dropMs);
+            }
         }
     }
 
+    // close the output file
+    if (outFD != -1 && close(outFD) == -1)
+        errExit("close output file failed");
+
 }
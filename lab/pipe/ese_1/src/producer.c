@@ -7,38 +7,61 @@
 #include <fcntl.h>
 
 #include "producer.h"
+#include "uring.h"
 #include "errExit.h"
 
 #define MSG_BYTES 100
 
-void producer (int *pipeFD, const char *filename) {
+void producer (int *pipeFD, const char *filename, enum TransferMode mode) {
     // Close the read-end of the pipe
     if (close(pipeFD[0]) == -1)
 	errExit("chiuso lettura - producer");
 
-    printf("<Producer> text file: %s\n", filename);
+    // in splice mode stdout may be the consumer's output: report on stderr
+    FILE *log = (mode == TRANSFER_SPLICE)? stderr : stdout;
+    fprintf(log, "<Producer> text file: %s\n", filename);
 
     // open filename for reading only
     int file = open(filename, O_RDONLY);
     if(file == -1)
 	errExit("file non aperto");
 
-    char buffer[MSG_BYTES];
-    ssize_t bR, bW = -1;
-    do {
-        // read max MSG_BYTES chars from the file
-        bR = read(file, buffer, MSG_BYTES);
+    if (mode == TRANSFER_SPLICE) {
+        // move the file pages into the pipe without copying them in user space
+        ssize_t bS = splice_all(file, pipeFD[1]);
+        fprintf(log, "<Producer> %zd bytes moved with splice\n", bS);
+    } else if (mode == TRANSFER_URING) {
+        // keep URING_DEPTH reads in flight, each write linked to the next read
+        ssize_t bU = uring_copy(file, pipeFD[1], URING_BLOCK, URING_DEPTH);
+        if (bU == -1) {
+            fprintf(log, "<Producer> io_uring is not available: falling back to read/write\n");
+            mode = TRANSFER_RW;
+        } else
+            fprintf(log, "<Producer> %zd bytes copied with io_uring\n", bU);
+    }
 
-        if (bR > 0) {	
-            // write bR chars to the pipe
-            if((write(pipeFD[1], buffer, MSG_BYTES)) == -1)
-		errExit("Scrittura - Producer");
-        }
-    } while (bR > 0);
+    if (mode == TRANSFER_RW) {
+        char buffer[MSG_BYTES];
+        ssize_t bR = -1;
+        do {
+            // read max MSG_BYTES chars from the file
+            bR = read(file, buffer, MSG_BYTES);
+
+            if (bR > 0) {
+                // write bR chars to the pipe
+                if((write(pipeFD[1], buffer, bR)) == -1)
+		    errExit("Scrittura - Producer");
+            }
+        } while (bR > 0);
+    }
 
     // Close the write end of the pipe
     if (close(pipeFD[1]) == -1)
         errExit("chiuso scrittura - producer");
 
+    // Close the file
+    if (close(file) == -1)
+        errExit("chiusura file - producer");
+
     return;
 }
@@ -0,0 +1,72 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "transfer.h"
+#include "errExit.h"
+
+// max number of bytes moved by a single splice call
+// (the default capacity of a pipe)
+#define SPLICE_BYTES 65536
+
+// chunk used by copy_all when splice_all falls back to read/write
+#define FALLBACK_BYTES 65536
+
+int parse_transfer_mode(const char *name, enum TransferMode *mode) {
+    if (strcmp(name, "rw") == 0)
+        *mode = TRANSFER_RW;
+    else if (strcmp(name, "splice") == 0)
+        *mode = TRANSFER_SPLICE;
+    else if (strcmp(name, "uring") == 0)
+        *mode = TRANSFER_URING;
+    else
+        return -1;
+    return 0;
+}
+
+ssize_t copy_all(int inFD, int outFD, size_t chunkSize) {
+    char buffer[chunkSize];
+    ssize_t total = 0, bR;
+    while ((bR = read(inFD, buffer, chunkSize)) != 0) {
+        if (bR == -1) {
+            if (errno == EINTR)
+                continue;
+            errExit("copy_all read failed");
+        }
+
+        // write can be partial (e.g. outFD is a pipe or a socket)
+        for (ssize_t off = 0; off < bR; ) {
+            ssize_t bW = write(outFD, buffer + off, bR - off);
+            if (bW == -1) {
+                if (errno == EINTR)
+                    continue;
+                errExit("copy_all write failed");
+            }
+            off += bW;
+        }
+        total += bR;
+    }
+    return total;
+}
+
+ssize_t splice_all(int inFD, int outFD) {
+    ssize_t total = 0, bS;
+    // splice moves the pages from inFD to outFD in the kernel:
+    // the bytes are never copied in user space
+    while ((bS = splice(inFD, NULL, outFD, NULL, SPLICE_BYTES,
+                        SPLICE_F_MOVE | SPLICE_F_MORE)) != 0) {
+        if (bS == -1) {
+            if (errno == EINTR)
+                continue;
+            // EINVAL: the file types of the two descriptors do not support splice
+            if (errno == EINVAL)
+                return total + copy_all(inFD, outFD, FALLBACK_BYTES);
+            errExit("splice failed");
+        }
+        total += bS;
+    }
+    return total;
+}
@@ -0,0 +1,384 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "uring.h"
+#include "errExit.h"
+
+// the states of a UringSlot
+#define SLOT_IDLE    0      /* no operation, no data                       */
+#define SLOT_READING 1      /* a read is in flight                         */
+#define SLOT_READY   2      /* the block can be returned by reader_next    */
+#define SLOT_WRITING 3      /* a write is in flight (and maybe a linked read) */
+
+// the user_data of an operation: the slot, and the kind of the operation
+#define OP_READ  0
+#define OP_WRITE 1
+#define OP_DATA(slot, op) (((uint64_t) (slot) << 1) | (op))
+
+// liburing is not needed: the three io_uring system calls are called directly
+static int sys_setup(unsigned entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned opcode, void *arg, unsigned nArgs) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nArgs);
+}
+
+static int uring_init(struct Uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = sys_setup(entries, &params);
+    if (ring->fd == -1)
+        return -1;
+
+    // map the submission and the completion rings (a single mapping,
+    // if the kernel supports it), and the array of submission entries
+    ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqMapSize > ring->sqMapSize)
+            ring->sqMapSize = ring->cqMapSize;
+        ring->cqMapSize = 0;
+    }
+
+    ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqMap == MAP_FAILED)
+        errExit("mmap sq ring failed");
+
+    ring->cqMap = ring->sqMap;
+    if (ring->cqMapSize > 0) {
+        ring->cqMap = mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqMap == MAP_FAILED)
+            errExit("mmap cq ring failed");
+    }
+
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        errExit("mmap sqes failed");
+
+    char *sq = ring->sqMap, *cq = ring->cqMap;
+    ring->sqHead = (unsigned *) (sq + params.sq_off.head);
+    ring->sqTail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *) (sq + params.sq_off.array);
+    ring->cqHead = (unsigned *) (cq + params.cq_off.head);
+    ring->cqTail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void uring_exit(struct Uring *ring) {
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqMapSize > 0)
+        munmap(ring->cqMap, ring->cqMapSize);
+    munmap(ring->sqMap, ring->sqMapSize);
+    if (close(ring->fd) == -1)
+        errExit("close io_uring failed");
+}
+
+// get a free submission entry: it is seen by the kernel at the next uring_submit
+static struct io_uring_sqe *uring_sqe(struct Uring *ring) {
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sqTail + ring->queued;
+    if (tail - head > *ring->sqMask)
+        errExit("io_uring submission ring full");
+
+    unsigned index = tail & *ring->sqMask;
+    ring->sqArray[index] = index;
+    ring->queued++;
+
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// submit the queued entries, and wait for at least waitNr completions.
+// It returns the number of io_uring_enter calls (0 if there was nothing to do)
+static int uring_submit(struct Uring *ring, unsigned waitNr) {
+    __atomic_store_n(ring->sqTail, *ring->sqTail + ring->queued, __ATOMIC_RELEASE);
+    ring->queued = 0;
+
+    unsigned toSubmit = *ring->sqTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    if (toSubmit == 0 && waitNr == 0)
+        return 0;
+
+    while (sys_enter(ring->fd, toSubmit, waitNr, (waitNr > 0)? IORING_ENTER_GETEVENTS : 0) == -1) {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            errExit("io_uring_enter failed");
+        toSubmit = *ring->sqTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    }
+    return 1;
+}
+
+int uring_available(void) {
+    struct Uring ring;
+    if (uring_init(&ring, 1) == -1)
+        return 0;
+    uring_exit(&ring);
+    return 1;
+}
+
+static char *slot_buffer(struct UringReader *reader, int s) {
+    return reader->buffers + (size_t) s * reader->blockBytes;
+}
+
+// read the rest of the block of slot s
+static void submit_read(struct UringReader *reader, int s) {
+    struct UringSlot *slot = &reader->slots[s];
+    struct io_uring_sqe *sqe = uring_sqe(&reader->ring);
+    sqe->opcode = reader->fixed? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = reader->fd;
+    sqe->addr = (uint64_t) (uintptr_t) (slot_buffer(reader, s) + slot->filled);
+    sqe->len = reader->blockBytes - slot->filled;
+    sqe->off = slot->offset + slot->filled;
+    sqe->buf_index = 0;
+    sqe->user_data = OP_DATA(s, OP_READ);
+    slot->state = SLOT_READING;
+    reader->inflight++;
+}
+
+// write the rest of the block of slot s: with IOSQE_IO_LINK, the next
+// entry starts only when the write is complete
+static void submit_write(struct UringReader *reader, int s, unsigned flags) {
+    struct UringSlot *slot = &reader->slots[s];
+    struct io_uring_sqe *sqe = uring_sqe(&reader->ring);
+    sqe->opcode = reader->fixed? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->flags = flags;
+    sqe->fd = reader->outFD;
+    sqe->addr = (uint64_t) (uintptr_t) (slot_buffer(reader, s) + slot->written);
+    sqe->len = slot->length - slot->written;
+    sqe->off = (uint64_t) -1;       /* the current position (a pipe has none) */
+    sqe->buf_index = 0;
+    sqe->user_data = OP_DATA(s, OP_WRITE);
+    slot->state = SLOT_WRITING;
+    reader->inflight++;
+}
+
+static void complete_read(struct UringReader *reader, int s, int res) {
+    struct UringSlot *slot = &reader->slots[s];
+    reader->reads++;
+
+    // the read was linked to a write which did not complete
+    if (res == -ECANCELED)
+        return;
+
+    if (res == -EINTR || res == -EAGAIN)
+        submit_read(reader, s);
+    else if (res < 0) {
+        reader->error = -res;
+        slot->state = SLOT_IDLE;
+    } else if (res == 0) {
+        reader->eof = 1;
+        slot->state = SLOT_READY;
+    } else {
+        // a short read is completed by another read
+        slot->filled += res;
+        if (slot->filled < reader->blockBytes)
+            submit_read(reader, s);
+        else
+            slot->state = SLOT_READY;
+    }
+}
+
+static void complete_write(struct UringReader *reader, int s, int res) {
+    struct UringSlot *slot = &reader->slots[s];
+    reader->writes++;
+
+    if (res < 0 && res != -EINTR && res != -EAGAIN) {
+        reader->error = -res;
+        reader->writing = 0;
+        slot->state = SLOT_IDLE;
+        return;
+    }
+
+    if (res > 0)
+        slot->written += res;
+    if (slot->written < slot->length) {
+        // a short write cancels the linked read: it is submitted again
+        // when the whole block has been written
+        if (slot->chained) {
+            slot->chained = 0;
+            slot->reread = 1;
+        }
+        submit_write(reader, s, 0);
+        return;
+    }
+
+    reader->writing = 0;
+    if (slot->chained) {
+        // the linked read is in flight
+        slot->chained = 0;
+        slot->state = SLOT_READING;
+    } else if (slot->reread) {
+        slot->reread = 0;
+        submit_read(reader, s);
+    } else
+        slot->state = SLOT_IDLE;
+}
+
+// submit the queued entries, wait for waitNr completions and handle them all
+static void reader_wait(struct UringReader *reader, unsigned waitNr) {
+    reader->enters += uring_submit(&reader->ring, waitNr);
+
+    struct Uring *ring = &reader->ring;
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+        int s = (int) (cqe->user_data >> 1);
+        reader->inflight--;
+        if ((cqe->user_data & 1) == OP_WRITE)
+            complete_write(reader, s, cqe->res);
+        else
+            complete_read(reader, s, cqe->res);
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+}
+
+int reader_init(struct UringReader *reader, size_t blockBytes, int depth) {
+    memset(reader, 0, sizeof(*reader));
+
+    // a block may need a read and a write at the same time
+    if (uring_init(&reader->ring, 2 * depth) == -1)
+        return -1;
+
+    reader->blockBytes = blockBytes;
+    reader->depth = depth;
+    reader->fd = reader->outFD = -1;
+    reader->buffers = aligned_alloc(4096, (depth * blockBytes + 4095) & ~(size_t) 4095);
+    reader->slots = calloc(depth, sizeof(struct UringSlot));
+    if (reader->buffers == NULL || reader->slots == NULL)
+        errExit("malloc failed");
+
+    // registered buffers are mapped once, instead of at each operation.
+    // If the kernel refuses them (e.g. RLIMIT_MEMLOCK), plain reads are used
+    struct iovec iov = {.iov_base = reader->buffers, .iov_len = depth * blockBytes};
+    reader->fixed = (sys_register(reader->ring.fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0);
+    return 0;
+}
+
+void reader_start(struct UringReader *reader, int fd) {
+    reader->fd = fd;
+    reader->next = 0;
+    reader->eof = reader->done = reader->writing = reader->error = 0;
+
+    // the first depth blocks are read at the same time
+    for (int s = 0; s < reader->depth; ++s) {
+        struct UringSlot *slot = &reader->slots[s];
+        memset(slot, 0, sizeof(*slot));
+        slot->offset = (off_t) s * reader->blockBytes;
+        submit_read(reader, s);
+    }
+    reader->offset = (off_t) reader->depth * reader->blockBytes;
+    reader->enters += uring_submit(&reader->ring, 0);
+}
+
+ssize_t reader_next(struct UringReader *reader, char **block) {
+    if (reader->done)
+        return 0;
+
+    // the blocks are written in order: the next one waits for the previous write
+    int s = reader->next % reader->depth;
+    struct UringSlot *slot = &reader->slots[s];
+    while (reader->error == 0 && (slot->state != SLOT_READY || reader->writing))
+        reader_wait(reader, 1);
+
+    if (reader->error != 0) {
+        errno = reader->error;
+        return -1;
+    }
+
+    // a partial block is the last one
+    if (slot->filled < reader->blockBytes)
+        reader->done = 1;
+    *block = slot_buffer(reader, s);
+    return slot->filled;
+}
+
+void reader_release(struct UringReader *reader, int outFD, size_t n) {
+    int s = reader->next % reader->depth;
+    struct UringSlot *slot = &reader->slots[s];
+    reader->next++;
+
+    // the buffer reads the block depth positions ahead
+    int rearm = !reader->eof && !reader->done;
+    if (rearm) {
+        slot->offset = reader->offset;
+        reader->offset += reader->blockBytes;
+    }
+
+    if (outFD != -1 && n > 0) {
+        // the read into the buffer is linked to the write of the buffer
+        reader->outFD = outFD;
+        slot->written = 0;
+        slot->length = n;
+        slot->chained = rearm;
+        slot->reread = 0;
+        submit_write(reader, s, rearm? IOSQE_IO_LINK : 0);
+        reader->writing = 1;
+        if (rearm) {
+            slot->filled = 0;
+            submit_read(reader, s);
+            slot->state = SLOT_WRITING;
+        }
+    } else if (rearm) {
+        slot->filled = 0;
+        submit_read(reader, s);
+    } else
+        slot->state = SLOT_IDLE;
+
+    reader->enters += uring_submit(&reader->ring, 0);
+}
+
+void reader_stop(struct UringReader *reader) {
+    while (reader->inflight > 0)
+        reader_wait(reader, 1);
+}
+
+void reader_free(struct UringReader *reader) {
+    reader_stop(reader);
+    uring_exit(&reader->ring);
+    free(reader->buffers);
+    free(reader->slots);
+}
+
+ssize_t uring_copy(int inFD, int outFD, size_t blockBytes, int depth) {
+    struct UringReader reader;
+    if (reader_init(&reader, blockBytes, depth) == -1)
+        return -1;
+    reader_start(&reader, inFD);
+
+    ssize_t total = 0, bR;
+    char *block;
+    while ((bR = reader_next(&reader, &block)) > 0) {
+        reader_release(&reader, outFD, bR);
+        total += bR;
+    }
+    if (bR == -1)
+        errExit("uring_copy failed");
+
+    // wait for the last write
+    reader_stop(&reader);
+    if (reader.error != 0) {
+        errno = reader.error;
+        errExit("uring_copy write failed");
+    }
+    reader_free(&reader);
+    return total;
+}
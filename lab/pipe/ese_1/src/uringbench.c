@@ -0,0 +1,165 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "transfer.h"
+#include "uring.h"
+#include "errExit.h"
+
+// uringbench compares the two engines of the producer, read/write and
+// io_uring, copying a file into a pipe drained by a child process.
+// Each file is copied with a cold page cache (its pages are dropped with
+// posix_fadvise before each run) and with a warm one
+
+static void usage (const char *prog) {
+    printf("Usage: %s [-b blockBytes] [-d depth] [-r repeats] file1 ... fileN\n", prog);
+    printf("  -b  bytes of each read (default %d)\n", URING_BLOCK);
+    printf("  -d  reads in flight with io_uring (default %d)\n", URING_DEPTH);
+    printf("  -r  runs of each engine (default 3)\n");
+}
+
+static double now_s (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the fraction of the pages of fd in the page cache
+static double resident (int fd, size_t size) {
+    if (size == 0)
+        return 1;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pages = (size + page - 1) / page, inCache = 0;
+    unsigned char *vec = malloc(pages);
+    if (vec != NULL && mincore(map, size, vec) == 0)
+        for (size_t i = 0; i < pages; ++i)
+            inCache += vec[i] & 1;
+    free(vec);
+    munmap(map, size);
+    return (double) inCache / pages;
+}
+
+// copy the file into a pipe with one engine.
+// It returns the elapsed seconds
+static double run (const char *filename, int useUring, int cold,
+                   size_t blockBytes, int depth, double *cached) {
+    int file = open(filename, O_RDONLY);
+    if (file == -1)
+        errExit("open failed");
+    struct stat st;
+    if (fstat(file, &st) == -1)
+        errExit("fstat failed");
+
+    // drop the (clean) pages of the file, or load all of them
+    if (cold)
+        posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+    else {
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull == -1)
+            errExit("open /dev/null failed");
+        copy_all(file, devNull, blockBytes);
+        close(devNull);
+    }
+    *cached = resident(file, st.st_size);
+    if (lseek(file, 0, SEEK_SET) == -1)
+        errExit("lseek failed");
+
+    int pipeFD[2];
+    if (pipe(pipeFD) == -1)
+        errExit("pipe failed");
+
+    // the child drains the pipe
+    pid_t pid = fork();
+    if (pid == -1)
+        errExit("fork failed");
+    if (pid == 0) {
+        close(pipeFD[1]);
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull == -1)
+            errExit("open /dev/null failed");
+        splice_all(pipeFD[0], devNull);
+        _exit(0);
+    }
+    close(pipeFD[0]);
+
+    double start = now_s();
+    ssize_t bytes = useUring? uring_copy(file, pipeFD[1], blockBytes, depth)
+                            : copy_all(file, pipeFD[1], blockBytes);
+    if (close(pipeFD[1]) == -1)
+        errExit("close failed");
+    if (waitpid(pid, NULL, 0) == -1)
+        errExit("waitpid failed");
+    double elapsed = now_s() - start;
+
+    if (bytes != st.st_size)
+        printf("<Bench> %s: %zd bytes copied out of %lld\n", filename, bytes,
+               (long long) st.st_size);
+    if (close(file) == -1)
+        errExit("close failed");
+    return elapsed;
+}
+
+int main (int argc, char *argv[]) {
+    size_t blockBytes = URING_BLOCK;
+    int depth = URING_DEPTH, repeats = 3, opt;
+    while ((opt = getopt(argc, argv, "b:d:r:")) != -1) {
+        switch (opt) {
+            case 'b':
+                blockBytes = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 0;
+        }
+    }
+    if (optind == argc || blockBytes == 0 || depth <= 0 || repeats <= 0) {
+        usage(argv[0]);
+        return 0;
+    }
+
+    int haveUring = uring_available();
+    if (!haveUring)
+        printf("<Bench> io_uring is not available: only read/write is measured\n");
+
+    printf("%-24s %-5s %-6s %8s %10s %10s\n", "file", "cache", "engine", "cached", "best MB/s", "mean MB/s");
+    for (int i = optind; i < argc; ++i) {
+        struct stat st;
+        if (stat(argv[i], &st) == -1) {
+            printf("<Bench> %s does not exist\n", argv[i]);
+            continue;
+        }
+
+        for (int cold = 1; cold >= 0; --cold)
+            for (int useUring = 0; useUring <= haveUring; ++useUring) {
+                double best = 0, sum = 0, cached = 0;
+                for (int r = 0; r < repeats; ++r) {
+                    double elapsed = run(argv[i], useUring, cold, blockBytes, depth, &cached);
+                    double speed = (elapsed > 0)? st.st_size / elapsed / 1e6 : 0;
+                    sum += speed;
+                    if (speed > best)
+                        best = speed;
+                }
+                printf("%-24s %-5s %-6s %7.0f%% %10.1f %10.1f\n", argv[i],
+                       cold? "cold" : "warm", useUring? "uring" : "rw",
+                       100 * cached, best, sum / repeats);
+            }
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "writer.h"
+#include "errExit.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+void writer_init(struct Writer *writer, int fd, const struct OutputConfig *config) {
+    writer->fd = fd;
+    writer->flushBytes = (config->flushBytes > 0)? config->flushBytes : FLUSH_BYTES;
+    writer->flushCount = (config->flushCount > 0)? config->flushCount : FLUSH_COUNT;
+    if (writer->flushCount > IOV_MAX)
+        writer->flushCount = IOV_MAX;
+
+    writer->iov = malloc(writer->flushCount * sizeof(struct iovec));
+    writer->arena = malloc(writer->flushBytes);
+    if (writer->iov == NULL || writer->arena == NULL)
+        errExit("writer malloc failed");
+
+    writer->count = 0;
+    writer->bytes = 0;
+    writer->arenaUsed = 0;
+    writer->writes = 0;
+}
+
+void writer_flush(struct Writer *writer) {
+    struct iovec *iov = writer->iov;
+    int count = writer->count;
+
+    // writev may write less bytes than requested (e.g. fd is a pipe):
+    // skip the written slices, and write the remaining ones again
+    while (count > 0) {
+        ssize_t bW = writev(writer->fd, iov, count);
+        if (bW == -1) {
+            if (errno == EINTR)
+                continue;
+            errExit("writev failed");
+        }
+        writer->writes++;
+
+        while (count > 0 && (size_t) bW >= iov->iov_len) {
+            bW -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + bW;
+            iov->iov_len -= bW;
+        }
+    }
+
+    writer->count = 0;
+    writer->bytes = 0;
+    writer->arenaUsed = 0;
+}
+
+// append a slice, flushing first if a threshold would be passed
+static void append(struct Writer *writer, const void *data, size_t len, int copy) {
+    if (writer->count == writer->flushCount ||
+        writer->bytes + len > writer->flushBytes ||
+        (copy && writer->arenaUsed + len > writer->flushBytes))
+        writer_flush(writer);
+
+    // a slice bigger than the arena is written at once
+    if (copy && len > writer->flushBytes) {
+        writer_add_const(writer, data, len);
+        writer_flush(writer);
+        return;
+    }
+
+    if (copy) {
+        memcpy(writer->arena + writer->arenaUsed, data, len);
+        data = writer->arena + writer->arenaUsed;
+        writer->arenaUsed += len;
+    }
+
+    writer->iov[writer->count].iov_base = (void *) data;
+    writer->iov[writer->count].iov_len = len;
+    writer->count++;
+    writer->bytes += len;
+}
+
+void writer_add(struct Writer *writer, const void *data, size_t len) {
+    append(writer, data, len, 1);
+}
+
+void writer_add_const(struct Writer *writer, const void *data, size_t len) {
+    append(writer, data, len, 0);
+}
+
+void writer_free(struct Writer *writer) {
+    writer_flush(writer);
+    free(writer->iov);
+    free(writer->arena);
+    writer->iov = NULL;
+    writer->arena = NULL;
+}
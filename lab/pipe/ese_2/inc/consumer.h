@@ -1,6 +1,38 @@
 #ifndef _CONSUMER_HH
 #define _CONSUMER_HH
 
-void consumer (int *pipeFD);
+#include <stddef.h>
+
+#include "writer.h"
+#include "frame.h"
+
+// the ConsumerConfig structure collects the consumer's command line options
+struct ConsumerConfig {
+    size_t chunkBytes;      /* max size of the value of an Item             */
+    int quantum;            /* max Items served per source at each wake up  */
+    struct OutputConfig output; /* how the Items are written on terminal    */
+    const char *outDir;     /* rebuild the files in outDir (NULL: print)    */
+    char **files;           /* the input files, indexed by fileId           */
+    int nFiles;
+    int topWords;           /* count the words, print the most frequent (0: off) */
+    int wordShards;         /* word counting threads (see words.h)          */
+};
+
+// The consumer method reads the Items of all the producers from a shared pipe.
+// If config->outDir is set, the Items are not printed: each input file is
+// rebuilt in config->outDir from the fileId and seq of its Items. If
+// config->topWords is set, the words of the Items are counted instead
+void consumer (int *pipeFD, const struct ConsumerConfig *config);
+
+// The consumer_run method handles the Items read by parser (from a pipe,
+// or from a ring with threads) until all the producers have finished
+void consumer_run (struct FrameParser *parser, const struct ConsumerConfig *config);
+
+// The consumer_epoll method reads the Items of nSources producers, each one
+// with its own pipe. readFDs holds the read ends of the pipes, names the
+// source of each pipe. The pipes are multiplexed with epoll: at each wake up
+// a ready source is served for at most config->quantum Items
+void consumer_epoll (int *readFDs, char **names, int nSources,
+                     const struct ConsumerConfig *config);
 
 #endif
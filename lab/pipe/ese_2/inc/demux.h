@@ -0,0 +1,54 @@
+#ifndef _DEMUX_HH
+#define _DEMUX_HH
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+
+// size of the write buffer of each output file
+#define STREAM_BYTES (256 * 1024)
+
+// A Stream rebuilds one of the input files from its Items
+struct Stream {
+    int fd;                     /* the output file (-1: not open)          */
+    char *buffer;               /* Items not written yet                   */
+    size_t used;                /* bytes in buffer                         */
+    uint32_t nextSeq;           /* the seq of the next expected Item       */
+    unsigned long long bytes;   /* bytes written to the output file        */
+    unsigned long writes;       /* number of write system calls            */
+    int state;                  /* STREAM_NEW, STREAM_OPEN, STREAM_DONE, STREAM_BROKEN */
+};
+
+#define STREAM_NEW    0
+#define STREAM_OPEN   1
+#define STREAM_DONE   2
+#define STREAM_BROKEN 3
+
+// A Demux splits the Items received from the pipe in per-file output streams.
+// The output file of the file i is outDir/basename(names[i]): it is opened
+// when its first Item arrives, and closed when its ITEM_LAST Item arrives
+struct Demux {
+    const char *outDir;
+    char **names;               /* the input files, indexed by fileId      */
+    int nFiles;
+    struct Stream *streams;
+};
+
+// The demux_init method prepares a Demux for nFiles input files.
+// It terminates the calling process if outDir can not be created
+void demux_init(struct Demux *demux, const char *outDir, char **names, int nFiles);
+
+// The demux_item method appends the value of an Item to the output stream of
+// its file. Items of a file must arrive in order (seq 0, 1, 2, ...).
+// It returns -1 if the fileId is unknown or the Item is out of order
+// (the stream is then marked as broken), otherwise 0.
+// It terminates the calling process if an output file can not be written
+int demux_item(struct Demux *demux, const struct ItemHeader *header, const char *value);
+
+// The demux_finish method flushes and closes the output files, and prints
+// a summary. Files without their ITEM_LAST Item are reported as incomplete.
+// It returns the number of files rebuilt completely
+int demux_finish(struct Demux *demux);
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef _FRAME_HH
+#define _FRAME_HH
+
+#include <limits.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// default max number of bytes carried by the value of an Item
+#define MSG_BYTES 100
+
+// min capacity of the consumer's ring buffer (it must be a power of two)
+#define RING_BYTES 65536
+
+// capacity of a batch when the pipe has a single producer:
+// atomicity is not needed, so a batch may be bigger than PIPE_BUF
+#define BATCH_BYTES 65536
+
+// flags of an Item
+#define ITEM_COMPRESSED 0x1     /* the value is an lz block of rawSize bytes  */
+#define ITEM_LAST       0x2     /* end of the file: the Item has no value     */
+
+// the header of a framed Item: 'size' bytes of value follow the header
+struct ItemHeader {
+    ssize_t size;       /* bytes of value in the pipe             */
+    uint32_t flags;     /* ITEM_COMPRESSED, ITEM_LAST             */
+    uint32_t rawSize;   /* bytes of value once decompressed       */
+    uint32_t fileId;    /* the file the Item comes from           */
+    uint32_t seq;       /* position of the Item in its file       */
+};
+
+struct ItemRing;
+
+// A FrameBatch packs many framed Items into a single buffer.
+// If the pipe is shared by many producers, the capacity must not exceed PIPE_BUF:
+// a batch is then written to the pipe atomically, and batches of concurrent
+// producers never interleave
+struct FrameBatch {
+    int fd;                 /* the write end of the pipe       */
+    struct ItemRing *shared; /* the ring replacing the pipe (threads), or NULL */
+    size_t used;            /* bytes already packed in buffer  */
+    size_t capacity;        /* size of buffer                  */
+    char *buffer;
+};
+
+// A FrameParser rebuilds framed Items from the read end of the pipe.
+// Bytes are read in large blocks into a ring buffer, and Items are extracted
+// incrementally: a frame split across two reads is completed by the next one
+struct FrameParser {
+    int fd;                 /* the read end of the pipe          */
+    struct ItemRing *shared; /* the ring replacing the pipe (threads), or NULL */
+    size_t head;            /* offset of the first unparsed byte */
+    size_t tail;            /* offset of the first free byte     */
+    size_t capacity;        /* size of ring (a power of two)     */
+    unsigned long reads;    /* number of read system calls       */
+    char *ring;
+};
+
+// The batch_init method prepares an empty batch of capacity bytes writing to fd.
+// It terminates the calling process if the buffer cannot be allocated
+void batch_init(struct FrameBatch *batch, int fd, size_t capacity);
+
+// The batch_init_ring method prepares an empty batch of capacity bytes
+// published to ring instead of a pipe (see ring.h).
+// It terminates the calling process if the buffer cannot be allocated
+void batch_init_ring(struct FrameBatch *batch, struct ItemRing *ring, size_t capacity);
+
+// The batch_add method appends an Item (header->size bytes of value) to the batch.
+// If the Item does not fit in the batch, the batch is flushed first.
+// It terminates the calling process if the write fails
+void batch_add(struct FrameBatch *batch, const struct ItemHeader *header, const char *value);
+
+// The batch_flush method writes the packed Items with a single write
+// (a batch bigger than PIPE_BUF may need more writes).
+// It terminates the calling process if the write fails
+void batch_flush(struct FrameBatch *batch);
+
+// The batch_free method releases the buffer of the batch
+void batch_free(struct FrameBatch *batch);
+
+// The parser_init method prepares an empty parser reading from fd.
+// The ring buffer can hold at least a frame with maxValue bytes of value.
+// It terminates the calling process if the ring cannot be allocated
+void parser_init(struct FrameParser *parser, int fd, size_t maxValue);
+
+// The parser_init_ring method prepares an empty parser reading from ring.
+// It terminates the calling process if the ring buffer cannot be allocated
+void parser_init_ring(struct FrameParser *parser, struct ItemRing *ring, size_t maxValue);
+
+// The parser_fill method reads as many bytes as fit in the ring buffer.
+// It must be called only if the ring buffer is not full.
+// It returns the number of read bytes, 0 on end-of-file, -1 on error
+ssize_t parser_fill(struct FrameParser *parser);
+
+// The parser_next method extracts the next complete Item from the ring buffer,
+// copying its value (at most maxValue bytes, even once decompressed) in value.
+// An ITEM_LAST Item has no value.
+// It returns 1 if an Item was extracted, 0 if the ring buffer does not hold
+// a complete frame yet, -1 if the stream is corrupted
+int parser_next(struct FrameParser *parser, struct ItemHeader *header,
+                char *value, size_t maxValue);
+
+// The parser_pending method returns the number of unparsed bytes
+size_t parser_pending(const struct FrameParser *parser);
+
+// The parser_full method returns 1 if there is no free space in the ring buffer
+int parser_full(const struct FrameParser *parser);
+
+// The parser_free method releases the ring buffer of the parser
+void parser_free(struct FrameParser *parser);
+
+#endif
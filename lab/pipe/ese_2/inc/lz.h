@@ -0,0 +1,28 @@
+#ifndef _LZ_HH
+#define _LZ_HH
+
+#include <stddef.h>
+
+// A self-contained LZ77 block codec (LZ4-like format).
+// A block is a list of sequences: a token byte (literals length in the high
+// nibble, match length - LZ_MIN_MATCH in the low nibble, 15 = more bytes
+// follow), the literals, and a 2 bytes little-endian offset of the match.
+// The last sequence has only literals
+
+// min length of a match
+#define LZ_MIN_MATCH 4
+
+// max distance of a match
+#define LZ_MAX_OFFSET 65535
+
+// The lz_compress method compresses srcLen bytes of src into dst.
+// It returns the compressed size, or 0 if the compressed block does not
+// fit in dstCap bytes (i.e. src is not compressible enough)
+size_t lz_compress(const char *src, size_t srcLen, char *dst, size_t dstCap);
+
+// The lz_decompress method decompresses the srcLen bytes block src into dst.
+// It returns the decompressed size, or -1 if the block is corrupted or does
+// not fit in dstCap bytes
+long lz_decompress(const char *src, size_t srcLen, char *dst, size_t dstCap);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _PIPELINE_HH
+#define _PIPELINE_HH
+
+#include "consumer.h"
+#include "producer.h"
+#include "pool.h"
+
+// the Pipeline structure collects what main prepares for a run: the same
+// options drive the producers as processes (pipes) or as threads (a ring)
+struct Pipeline {
+    struct ConsumerConfig *config;
+    struct ProducerConfig *producerConfig;
+    char **files;                   /* the input files, indexed by fileId  */
+    struct WorkQueue *queue;        /* the files not taken yet             */
+    int nWorkers;                   /* number of producers                 */
+    int useEpoll;                   /* 1: a channel per producer (-e)      */
+};
+
+// The pipeline_check method checks the options which depend on the channel
+// between producers and consumer.
+// It returns 0 if they can be used, otherwise -1 (and it prints why)
+int pipeline_check(const struct ConsumerConfig *config, int useEpoll);
+
+// The pipeline_run method starts the producers, runs the consumer, and
+// returns when all the producers have terminated.
+// It is implemented by processes.c (pipes) and by threads.c (a ring)
+void pipeline_run(struct Pipeline *pipeline);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _POOL_HH
+#define _POOL_HH
+
+#include <stddef.h>
+#include <stdint.h>
+
+// size of a cache line: the counters written by different processes are
+// kept in different cache lines, so they do not bounce between the cores
+#define CACHE_LINE 64
+
+// A FileList collects the input files: the id of a file is its index
+struct FileList {
+    char **names;
+    int count;
+    int capacity;
+};
+
+// The WorkerStats structure collects what a producer of the pool did
+struct WorkerStats {
+    _Alignas(CACHE_LINE) unsigned long files;   /* files sent to the consumer */
+    unsigned long failed;                       /* files that could not be read */
+    unsigned long long bytes;                   /* bytes read from the files  */
+    uint64_t busyNs;                            /* time spent on the files    */
+};
+
+// A WorkQueue lives in a shared mapping created before fork(): the producers
+// of the pool take the next file with an atomic fetch-add on 'next', so
+// a producer that finishes early just takes more files
+struct WorkQueue {
+    _Alignas(CACHE_LINE) uint32_t next;         /* index of the next file     */
+    uint32_t nFiles;
+    int nWorkers;
+    size_t mappingSize;
+    struct WorkerStats stats[];                 /* one for each producer      */
+};
+
+// The filelist_add method adds path to the list: a directory is walked
+// recursively (in alphabetical order), symbolic links to directories are
+// not followed.
+// It returns the number of files added, -1 if path does not exist
+int filelist_add(struct FileList *list, const char *path);
+
+// The filelist_free method frees the names of the list
+void filelist_free(struct FileList *list);
+
+// The workqueue_create method maps a shared WorkQueue for nFiles files
+// and nWorkers producers.
+// It terminates the calling process if the mapping can not be created
+struct WorkQueue *workqueue_create(uint32_t nFiles, int nWorkers);
+
+// The workqueue_take method returns the index of the next file to read,
+// or -1 if all files were taken
+long workqueue_take(struct WorkQueue *queue);
+
+// The workqueue_summary method prints files, bytes and throughput of each
+// producer and of the whole run, which lasted elapsedNs nanoseconds
+void workqueue_summary(const struct WorkQueue *queue, uint64_t elapsedNs);
+
+// The workqueue_destroy method unmaps the WorkQueue.
+// It terminates the calling process if munmap fails
+void workqueue_destroy(struct WorkQueue *queue);
+
+// The default_workers method returns the number of online cores (at least 1)
+int default_workers(void);
+
+#endif
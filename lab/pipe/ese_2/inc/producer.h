@@ -1,6 +1,32 @@
 #ifndef _PRODUCER_HH
 #define _PRODUCER_HH
 
-void producer (int *pipeFD, const char *filename);
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pool.h"
+#include "frame.h"
+
+// the ProducerConfig structure collects the producer's command line options
+struct ProducerConfig {
+    size_t chunkBytes;      /* max size of the value of an Item             */
+    size_t batchBytes;      /* max size of a single write (at most PIPE_BUF
+                               if the pipe is shared with other producers)  */
+    int compress;           /* 1: compress each chunk with the lz codec     */
+    int uring;              /* 1: read the files with io_uring              */
+};
+
+// The producer method is run by each process of the pool: it takes the index
+// of the next file from queue, and sends the Items of files[index] (tagged
+// with the index as fileId) until all the files were taken. worker is the
+// producer's position in the pool, where it records its WorkerStats
+void producer (int *pipeFD, struct WorkQueue *queue, int worker, char **files,
+               const struct ProducerConfig *config);
+
+// The producer_loop method sends the files taken from queue through batch,
+// which writes to a pipe or publishes to a ring (threads).
+// It flushes the batch when all the files were taken
+void producer_loop (struct FrameBatch *batch, struct WorkQueue *queue, int worker,
+                    char **files, const struct ProducerConfig *config);
 
 #endif
@@ -0,0 +1,61 @@
+#ifndef _RING_HH
+#define _RING_HH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "pool.h"
+
+// default capacity of the ring shared by the producer threads
+// (it must be a power of two)
+#define ITEM_RING_BYTES (1024 * 1024)
+
+// spins before a thread sleeps on a futex
+#define RING_SPIN 128
+
+// An ItemRing replaces the pipe when the producers and the consumer are
+// threads of the same process: it is a bounded ring of bytes with many
+// producers and a single consumer (MPSC).
+// A producer reserves the room of a whole batch with an atomic fetch-add
+// on 'reserve', copies the batch, and publishes it by moving 'commit' when
+// the batches reserved before it have been published: batches never
+// interleave, exactly as the atomic writes to a pipe.
+// Each index is a free-running byte counter in its own cache line:
+// producers and consumer do not write the same cache lines
+struct ItemRing {
+    _Alignas(CACHE_LINE) uint64_t reserve;  /* bytes reserved by producers   */
+    _Alignas(CACHE_LINE) uint64_t commit;   /* bytes published by producers  */
+    uint32_t published;                     /* futex: bumped at each publish */
+    uint32_t publishWaiters;                /* threads sleeping on published */
+    int open;                               /* producers not closed yet      */
+    unsigned long publishes;                /* batches published             */
+    _Alignas(CACHE_LINE) uint64_t head;     /* bytes consumed                */
+    uint32_t consumed;                      /* futex: bumped at each consume */
+    uint32_t roomWaiters;                   /* producers sleeping on consumed */
+    _Alignas(CACHE_LINE) size_t capacity;
+    char *buffer;
+};
+
+// The ring_init method prepares an empty ring of capacity bytes (a power
+// of two) for nProducers producers.
+// It terminates the calling process if the buffer can not be allocated
+void ring_init(struct ItemRing *ring, size_t capacity, int nProducers);
+
+// The ring_write method publishes n bytes (at most the capacity of the ring)
+// as a single block, waiting for room if the ring is full
+void ring_write(struct ItemRing *ring, const void *data, size_t n);
+
+// The ring_readv method moves the published bytes into the iovcnt buffers,
+// waiting until some bytes are published.
+// It returns the number of moved bytes, 0 if all producers are closed and
+// the ring is empty
+size_t ring_readv(struct ItemRing *ring, const struct iovec *iov, int iovcnt);
+
+// The ring_close method tells the consumer that a producer has finished
+void ring_close(struct ItemRing *ring);
+
+// The ring_free method releases the buffer of the ring
+void ring_free(struct ItemRing *ring);
+
+#endif
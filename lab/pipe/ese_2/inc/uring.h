@@ -0,0 +1,98 @@
+#ifndef _URING_HH
+#define _URING_HH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+// default size of a block read from the file
+#define URING_BLOCK (64 * 1024)
+
+// default number of blocks read at the same time (queue depth)
+#define URING_DEPTH 8
+
+// A Uring is an io_uring instance, driven with the raw system calls:
+// the submission and completion rings are shared with the kernel
+struct Uring {
+    int fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned queued;                /* sqes not submitted yet              */
+    void *sqMap, *cqMap;
+    size_t sqMapSize, cqMapSize, sqesSize;
+};
+
+// A UringSlot is a buffer of the reader: it holds one block of the file
+struct UringSlot {
+    off_t offset;                   /* offset of the block in the file     */
+    size_t filled;                  /* bytes of the block read so far      */
+    size_t written;                 /* bytes of the block written so far   */
+    size_t length;                  /* bytes of the block to write         */
+    int state;                      /* SLOT_IDLE, SLOT_READING, ...        */
+    int chained;                    /* 1: a read is linked to the write    */
+    int reread;                     /* 1: read again once the write is done */
+};
+
+// A UringReader keeps depth reads of a file in flight, and returns the
+// blocks in order. A returned block can be written to a pipe by the ring
+// itself: the write is linked to the next read into the same buffer, so
+// the write and the read are submitted with a single system call
+struct UringReader {
+    struct Uring ring;
+    int fd;                         /* the file being read                 */
+    int outFD;                      /* where the blocks are written        */
+    size_t blockBytes;
+    int depth;
+    char *buffers;                  /* depth blocks of blockBytes bytes    */
+    int fixed;                      /* 1: buffers registered in the kernel */
+    struct UringSlot *slots;
+    unsigned long next;             /* index of the next block to return   */
+    off_t offset;                   /* offset of the next read to submit   */
+    int eof;                        /* 1: the end of the file was reached  */
+    int done;                       /* 1: the last block was returned      */
+    int writing;                    /* 1: a write is in flight             */
+    int inflight;                   /* operations not completed yet        */
+    int error;                      /* errno of a failed operation, or 0   */
+    unsigned long reads, writes;    /* completed operations                */
+    unsigned long enters;           /* io_uring_enter system calls         */
+};
+
+// The uring_available method tells if the kernel supports io_uring.
+// It returns 1 if it does, 0 otherwise
+int uring_available(void);
+
+// The reader_init method creates the ring and the buffers of a reader.
+// It returns -1 (with errno set) if io_uring is not available
+int reader_init(struct UringReader *reader, size_t blockBytes, int depth);
+
+// The reader_start method submits the first reads of fd.
+// It terminates the calling process if the reads can not be submitted
+void reader_start(struct UringReader *reader, int fd);
+
+// The reader_next method waits for the next block of the file.
+// It returns its size (and the block in *block), 0 at the end of the file,
+// -1 (with errno set) if a read or a write failed
+ssize_t reader_next(struct UringReader *reader, char **block);
+
+// The reader_release method gives back the block returned by reader_next,
+// so its buffer can read another block. If outFD is not -1, the first n bytes
+// of the block are written to outFD before the buffer is reused
+void reader_release(struct UringReader *reader, int outFD, size_t n);
+
+// The reader_stop method waits for the operations still in flight on
+// the current file, which can then be closed
+void reader_stop(struct UringReader *reader);
+
+// The reader_free method closes the ring and frees the buffers
+void reader_free(struct UringReader *reader);
+
+// The uring_copy method copies all the bytes from inFD to outFD, keeping
+// depth reads of blockBytes bytes in flight.
+// It returns the number of copied bytes, -1 if io_uring is not available,
+// otherwise it terminates the calling process
+ssize_t uring_copy(int inFD, int outFD, size_t blockBytes, int depth);
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef _WORDS_HH
+#define _WORDS_HH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "frame.h"
+
+// max bytes of a counted word: longer tokens are counted by their prefix
+#define WORD_MAX 64
+
+// initial number of slots of a WordTable (a power of two)
+#define WORD_TABLE_SLOTS 4096
+
+// bytes of Items handed to a shard at once, and max jobs queued per shard
+#define WORD_JOB_BYTES (64 * 1024)
+#define WORD_QUEUE 8
+
+// A WordSlot is a slot of the open-addressing table: 24 bytes, so a probe
+// usually reads a single cache line. The bytes of the word are in the arena
+struct WordSlot {
+    uint64_t hash;              /* 0: empty slot                         */
+    uint64_t count;
+    uint32_t len;
+    uint32_t offset;            /* position of the word in the arena     */
+};
+
+// A WordTable counts words with linear probing. It doubles when it is
+// 70% full
+struct WordTable {
+    struct WordSlot *slots;
+    size_t capacity;            /* number of slots (a power of two)      */
+    size_t used;                /* number of distinct words              */
+    char *arena;                /* the bytes of the words                */
+    size_t arenaUsed, arenaCapacity;
+};
+
+// A WordCarry keeps the token cut at the end of an Item: the next Item
+// of the same file completes it
+struct WordCarry {
+    char word[WORD_MAX];
+    size_t len;                 /* bytes of the token seen so far        */
+};
+
+// A WordJob carries many Items from the consumer to a shard thread
+struct WordJob {
+    size_t used;
+    char data[WORD_JOB_BYTES];
+};
+
+// A WordShard counts the words of the files with fileId % nShards == its index.
+// With more than one shard, each shard is a thread fed with WordJobs
+struct WordShard {
+    struct WordTable table;
+    unsigned long long tokens;  /* tokens counted by the shard           */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     /* a job was queued or taken             */
+    struct WordJob *queue[WORD_QUEUE];
+    int head, count;            /* the queued jobs                       */
+    int closed;                 /* 1: no more jobs                       */
+    struct WordJob *filling;    /* the job the consumer is filling       */
+    struct WordCarry *carries;  /* the carry of each file (shared)       */
+};
+
+// A WordCounter tokenizes the values of the Items and counts the words.
+// A word is a run of ASCII letters, digits or non ASCII (UTF-8) bytes:
+// the other bytes are delimiters, found with an AVX2 or SSE2 classifier.
+// ASCII letters are counted in lower case
+struct WordCounter {
+    int nShards;
+    struct WordShard *shards;
+    struct WordCarry *carries;  /* one for each file                     */
+    int nFiles;
+    unsigned long long bytes;   /* bytes tokenized                       */
+};
+
+// The word_mask method classifies n bytes (at most 64) starting at p:
+// bit i of the result is set if p[i] is a word byte
+uint64_t word_mask(const char *p, size_t n);
+
+// The word_kernel method returns the name of the kernel used by word_mask
+const char *word_kernel(void);
+
+// The counter_init method prepares a counter for nFiles files, with nShards
+// shards (one thread each if nShards > 1).
+// It terminates the calling process if the memory or the threads can not be allocated
+void counter_init(struct WordCounter *counter, int nShards, int nFiles);
+
+// The counter_item method tokenizes the value of an Item (size bytes, already
+// decompressed). An ITEM_LAST Item ends the last token of its file.
+// It returns -1 if the fileId of the Item is unknown, otherwise 0
+int counter_item(struct WordCounter *counter, const struct ItemHeader *header,
+                 const char *value, size_t size);
+
+// The counter_finish method waits for the shards, merges their tables and
+// prints the k most frequent words and the tokens per second, elapsed
+// being the seconds since the consumer started
+void counter_finish(struct WordCounter *counter, int k, double elapsed);
+
+#endif
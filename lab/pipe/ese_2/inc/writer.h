@@ -0,0 +1,54 @@
+#ifndef _WRITER_HH
+#define _WRITER_HH
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+// default thresholds of a Writer
+#define FLUSH_BYTES 65536
+#define FLUSH_COUNT 512
+
+// the OutputConfig structure collects the output options of a consumer
+struct OutputConfig {
+    int countOnly;          /* 1: no output, only count bytes and chunks     */
+    size_t flushBytes;      /* flush the Writer when it holds so many bytes  */
+    int flushCount;         /* flush the Writer when it holds so many slices */
+};
+
+// A Writer gathers many slices (e.g. a prefix and a payload) into an iovec
+// array, and writes them with a single writev when a threshold is hit.
+// The bytes of a slice are copied in an arena, so the caller can reuse its
+// buffer; constant slices (string literals) can be added without copies
+struct Writer {
+    int fd;                 /* the output file descriptor        */
+    size_t flushBytes;      /* bytes threshold                   */
+    int flushCount;         /* slices threshold (at most IOV_MAX) */
+    struct iovec *iov;      /* the pending slices                */
+    int count;              /* number of pending slices          */
+    size_t bytes;           /* number of pending bytes           */
+    char *arena;            /* copies of the pending slices      */
+    size_t arenaUsed;
+    unsigned long writes;   /* number of writev system calls     */
+};
+
+// The writer_init method prepares an empty Writer for fd with the thresholds
+// of config. It terminates the calling process if the memory can not be allocated
+void writer_init(struct Writer *writer, int fd, const struct OutputConfig *config);
+
+// The writer_add method appends a copy of len bytes of data.
+// It terminates the calling process if a flush fails
+void writer_add(struct Writer *writer, const void *data, size_t len);
+
+// The writer_add_const method appends len bytes of data without copying them:
+// data must stay valid until the next flush (e.g. a string literal).
+// It terminates the calling process if a flush fails
+void writer_add_const(struct Writer *writer, const void *data, size_t len);
+
+// The writer_flush method writes all the pending slices.
+// It terminates the calling process if writev fails
+void writer_flush(struct Writer *writer);
+
+// The writer_free method flushes the pending slices, and releases the memory
+void writer_free(struct Writer *writer);
+
+#endif
@@ -1,46 +1,348 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/epoll.h>
 
 #include "consumer.h"
+#include "frame.h"
+#include "writer.h"
+#include "lz.h"
+#include "demux.h"
+#include "words.h"
 #include "errExit.h"
 
-#define MSG_BYTES 100
+// max number of events returned by a single epoll_wait
+#define MAX_EVENTS 64
 
-void consumer (int *pipeFD) {
-    // close pipe's write-end
-    if (close(pipeFD[1]) == -1)
-	errExit("chiuso - consumer");
+// the Source structure keeps the state of a producer's pipe in epoll mode
+struct Source {
+    const char *name;           /* the file read by the producer        */
+    struct FrameParser parser;  /* Items received from the pipe         */
+    unsigned long items;        /* number of Items received             */
+    int eof;                    /* 1 if all the pipe's write ends were closed */
+    int queued;                 /* 1 if the Source is in the backlog    */
+};
+
+// the Sink structure collects the Items received by the consumer
+struct Sink {
+    struct Writer writer;       /* gathers the output into large writes */
+    int countOnly;              /* 1: count the Items, no output        */
+    unsigned long items;        /* number of received Items             */
+    unsigned long long bytes;   /* bytes of the received values         */
+    unsigned long compressed;   /* number of compressed Items           */
+    unsigned long long wireBytes; /* bytes of the values in the pipe    */
+    char *unpacked;             /* the value of a decompressed Item     */
+    size_t maxValue;            /* size of unpacked                     */
+    struct timespec start;      /* when the consumer started            */
+    int demuxing;               /* 1: rebuild the files, no output      */
+    struct Demux demux;         /* the rebuilt files (demuxing)         */
+    int topWords;               /* >0: count the words, no output       */
+    struct WordCounter words;   /* the counted words (topWords)         */
+};
+
+static const char linePrefix[] = "<Consumer> line: ";
+
+static void sink_init (struct Sink *sink, const struct ConsumerConfig *config) {
+    // the consumer's messages written so far must precede the Items
+    fflush(stdout);
+    writer_init(&sink->writer, STDOUT_FILENO, &config->output);
+    sink->countOnly = config->output.countOnly;
+    sink->items = 0;
+    sink->bytes = 0;
+    sink->compressed = 0;
+    sink->wireBytes = 0;
+    sink->maxValue = config->chunkBytes;
+    sink->unpacked = malloc(config->chunkBytes);
+    if (sink->unpacked == NULL)
+        errExit("malloc failed");
+    clock_gettime(CLOCK_MONOTONIC, &sink->start);
+
+    sink->demuxing = (config->outDir != NULL && !sink->countOnly);
+    if (sink->demuxing)
+        demux_init(&sink->demux, config->outDir, config->files, config->nFiles);
+
+    sink->topWords = sink->countOnly? 0 : config->topWords;
+    if (sink->topWords > 0)
+        counter_init(&sink->words, config->wordShards, config->nFiles);
+}
+
+// print a message of the consumer after the Items received so far
+static void sink_log (struct Sink *sink, const char *format, ...) {
+    writer_flush(&sink->writer);
+
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    fflush(stdout);
+}
+
+static void sink_finish (struct Sink *sink) {
+    writer_free(&sink->writer);
+    free(sink->unpacked);
+
+    if (sink->demuxing)
+        demux_finish(&sink->demux);
+
+    if (sink->topWords > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        counter_finish(&sink->words, sink->topWords,
+                       (now.tv_sec - sink->start.tv_sec) + (now.tv_nsec - sink->start.tv_nsec) / 1e9);
+    }
+
+    if (sink->compressed > 0)
+        printf("<Consumer> %lu compressed items, %llu bytes in the pipe for %llu bytes (%.1f%%)\n",
+               sink->compressed, sink->wireBytes, sink->bytes,
+               (sink->bytes > 0)? 100.0 * sink->wireBytes / sink->bytes : 0);
+
+    if (sink->countOnly) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - sink->start.tv_sec) +
+                         (now.tv_nsec - sink->start.tv_nsec) / 1e9;
+        printf("<Consumer> %llu bytes, %lu chunks in %.3f s (%.1f MB/s)\n",
+               sink->bytes, sink->items, elapsed,
+               (elapsed > 0)? sink->bytes / elapsed / 1e6 : 0);
+    }
+}
+
+// print an Item on terminal: prefix, value and '\n' are gathered by the
+// Writer, and written with a single writev for many Items.
+// A compressed Item is decompressed first. When demuxing, the value is
+// appended to the file it comes from instead; when counting words, the
+// value is tokenized.
+// It returns -1 if the compressed value is corrupted
+static int handle_item (struct Sink *sink, const struct ItemHeader *header, const char *value) {
+    ssize_t size = header->size;
+    sink->wireBytes += size;
+
+    // the end-of-file marker has no value
+    if (header->flags & ITEM_LAST) {
+        if (sink->demuxing && demux_item(&sink->demux, header, NULL) == -1)
+            sink_log(sink, "<Consumer> unexpected end of file %u\n", header->fileId);
+        if (sink->topWords > 0)
+            counter_item(&sink->words, header, NULL, 0);
+        return 0;
+    }
+
+    if (header->flags & ITEM_COMPRESSED) {
+        long rawSize = lz_decompress(value, size, sink->unpacked, sink->maxValue);
+        if (rawSize != (long) header->rawSize)
+            return -1;
+        value = sink->unpacked;
+        size = rawSize;
+        sink->compressed++;
+    }
+
+    sink->items++;
+    sink->bytes += size;
+    if (sink->countOnly)
+        return 0;
+
+    if (sink->topWords > 0) {
+        if (counter_item(&sink->words, header, value, size) == -1)
+            sink_log(sink, "<Consumer> item %u of the unknown file %u\n",
+                     header->seq, header->fileId);
+        return 0;
+    }
+
+    if (sink->demuxing) {
+        if (demux_item(&sink->demux, header, value) == -1)
+            sink_log(sink, "<Consumer> item %u of file %u is out of order\n",
+                     header->seq, header->fileId);
+        return 0;
+    }
+
+    writer_add_const(&sink->writer, linePrefix, sizeof(linePrefix) - 1);
+    writer_add(&sink->writer, value, size);
+    writer_add_const(&sink->writer, "\n", 1);
+    return 0;
+}
+
+void consumer_run (struct FrameParser *parser, const struct ConsumerConfig *config) {
+    struct ItemHeader header;
+    char *buffer = malloc(config->chunkBytes);
+    if (buffer == NULL)
+        errExit("malloc failed");
+
+    struct Sink sink;
+    sink_init(&sink, config);
 
     ssize_t rB = -1;
-    char buffer[MSG_BYTES + 1];
     do {
-        // first we read the 'size' field of an Item
-        ssize_t size;
-        rB = read(pipeFD[0], &size, sizeof(ssize_t));
+        rB = parser_fill(parser);
         if (rB == -1)
-            printf("<Consumer> it looks like the pipe is broken\n");
+            sink_log(&sink, "<Consumer> it looks like the pipe is broken\n");
         else if (rB == 0)
-            printf("<Consumer> it looks like all pipe's write ends were closed\n");
-        else if (rB < sizeof(ssize_t))
-            printf("<Consumer> it looks like there is not ssize_t\n");
-        else {
-            // then, we read the 'value' field of an Item
-            rB = read(pipeFD[0], buffer, size);
-            if (rB == -1)
-                printf("<Consumer> it looks like the pipe is broken\n");
-            else if (rB == 0)
-                printf("<Consumer> it looks like all pipe's write ends were closed\n");
-            else if (rB < size)
-                printf("<Consumer> it looks like there is not enough data\n");
-            else {
-                buffer[size] = '\0';
-                printf("<Consumer> line: %s\n", buffer);
+            sink_log(&sink, "<Consumer> it looks like all pipe's write ends were closed\n");
+
+        // extract all the complete Items received so far
+        int res;
+        while ((res = parser_next(parser, &header, buffer, config->chunkBytes)) == 1)
+            if (handle_item(&sink, &header, buffer) == -1) {
+                res = -1;
+                break;
             }
+
+        if (res == -1) {
+            sink_log(&sink, "<Consumer> it looks like the stream is corrupted\n");
+            break;
         }
     } while (rB > 0);
 
+    if (parser_pending(parser) > 0)
+        sink_log(&sink, "<Consumer> it looks like there is not enough data\n");
+
+    sink_finish(&sink);
+    printf("<Consumer> %lu items received with %lu reads, %lu writes\n",
+           sink.items, parser->reads, sink.writer.writes);
+    free(buffer);
+}
+
+void consumer (int *pipeFD, const struct ConsumerConfig *config) {
+    // close pipe's write-end
+    if (close(pipeFD[1]) == -1)
+	errExit("chiuso - consumer");
+
+    // the parser reads the pipe in large blocks, and rebuilds the Items
+    // (even the ones split across two reads)
+    struct FrameParser parser;
+    parser_init(&parser, pipeFD[0], config->chunkBytes);
+    consumer_run(&parser, config);
+    parser_free(&parser);
+
     // close pipe's read end
     if (close(pipeFD[0]) == -1)
 	errExit("chiuso - consumer");
 }
+
+// serve a ready Source: read its pipe once, then handle at most quantum Items.
+// It returns 1 if the Source may still hold complete Items
+static int serve_source (struct Source *src, struct Sink *sink, char *buffer,
+                         const struct ConsumerConfig *config) {
+    struct FrameParser *parser = &src->parser;
+
+    if (!src->eof && !parser_full(parser)) {
+        ssize_t rB = parser_fill(parser);
+        if (rB == -1)
+            sink_log(sink, "<Consumer> it looks like the pipe of %s is broken\n", src->name);
+        if (rB <= 0)
+            src->eof = 1;
+    }
+
+    struct ItemHeader header;
+    int served = 0, res = 0;
+    while (served < config->quantum &&
+           (res = parser_next(parser, &header, buffer, config->chunkBytes)) == 1) {
+        if (handle_item(sink, &header, buffer) == -1) {
+            res = -1;
+            break;
+        }
+        if (!(header.flags & ITEM_LAST))
+            src->items++;
+        served++;
+    }
+
+    if (res == -1) {
+        sink_log(sink, "<Consumer> it looks like the stream of %s is corrupted\n", src->name);
+        src->eof = 1;
+        parser->head = parser->tail;
+        return 0;
+    }
+    return served == config->quantum;
+}
+
+void consumer_epoll (int *readFDs, char **names, int nSources,
+                     const struct ConsumerConfig *config) {
+    int epfd = epoll_create1(0);
+    if (epfd == -1)
+        errExit("epoll_create1 failed");
+
+    struct Source *sources = calloc(nSources, sizeof(struct Source));
+    // sources with complete Items left after their quantum
+    struct Source **backlog = calloc(nSources, sizeof(struct Source *));
+    char *buffer = malloc(config->chunkBytes);
+    if (sources == NULL || backlog == NULL || buffer == NULL)
+        errExit("malloc failed");
+
+    struct Sink sink;
+    sink_init(&sink, config);
+
+    // register the read end of each pipe
+    for (int i = 0; i < nSources; ++i) {
+        sources[i].name = names[i];
+        parser_init(&sources[i].parser, readFDs[i], config->chunkBytes);
+
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &sources[i]};
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, readFDs[i], &ev) == -1)
+            errExit("epoll_ctl failed");
+    }
+
+    int open = nSources, nBacklog = 0;
+    struct epoll_event events[MAX_EVENTS];
+    while (open > 0 || nBacklog > 0) {
+        // do not sleep if some sources still hold complete Items
+        int n = 0;
+        if (open > 0) {
+            n = epoll_wait(epfd, events, MAX_EVENTS, (nBacklog > 0)? 0 : -1);
+            if (n == -1)
+                errExit("epoll_wait failed");
+        }
+
+        // the sources in the backlog are served again, after the ready ones
+        struct Source *ready[MAX_EVENTS + nSources];
+        int nReady = 0;
+        for (int i = 0; i < n; ++i) {
+            struct Source *src = events[i].data.ptr;
+            if (!src->queued)
+                ready[nReady++] = src;
+        }
+        for (int i = 0; i < nBacklog; ++i) {
+            ready[nReady++] = backlog[i];
+            backlog[i]->queued = 0;
+        }
+        nBacklog = 0;
+
+        for (int i = 0; i < nReady; ++i) {
+            struct Source *src = ready[i];
+            int wasOpen = !src->eof;
+
+            if (serve_source(src, &sink, buffer, config)) {
+                src->queued = 1;
+                backlog[nBacklog++] = src;
+            }
+
+            // the producer closed its pipe: stop watching it
+            if (wasOpen && src->eof) {
+                if (epoll_ctl(epfd, EPOLL_CTL_DEL, src->parser.fd, NULL) == -1)
+                    errExit("epoll_ctl failed");
+                if (close(src->parser.fd) == -1)
+                    errExit("close failed");
+                open--;
+            }
+        }
+    }
+
+    sink_finish(&sink);
+
+    // report the state of each source
+    for (int i = 0; i < nSources; ++i) {
+        struct Source *src = &sources[i];
+        if (parser_pending(&src->parser) > 0)
+            printf("<Consumer> it looks like there is not enough data from %s\n", src->name);
+        printf("<Consumer> %s: %lu items received with %lu reads\n",
+               src->name, src->items, src->parser.reads);
+        parser_free(&src->parser);
+    }
+    printf("<Consumer> %lu items received, %lu writes\n", sink.items, sink.writer.writes);
+
+    free(sources);
+    free(backlog);
+    free(buffer);
+
+    if (close(epfd) == -1)
+        errExit("close failed");
+}
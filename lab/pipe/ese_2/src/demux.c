@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "demux.h"
+#include "errExit.h"
+
+void demux_init(struct Demux *demux, const char *outDir, char **names, int nFiles) {
+    if (mkdir(outDir, 0755) == -1 && errno != EEXIST)
+        errExit("mkdir failed");
+
+    demux->outDir = outDir;
+    demux->names = names;
+    demux->nFiles = nFiles;
+    demux->streams = calloc(nFiles, sizeof(struct Stream));
+    if (demux->streams == NULL)
+        errExit("calloc failed");
+
+    for (int i = 0; i < nFiles; ++i)
+        demux->streams[i].fd = -1;
+}
+
+// write size bytes of data to the output file of a stream
+static void stream_write(struct Stream *stream, const char *data, size_t size) {
+    for (size_t off = 0; off < size; ) {
+        ssize_t bW = write(stream->fd, data + off, size - off);
+        if (bW == -1) {
+            if (errno == EINTR)
+                continue;
+            errExit("stream write failed");
+        }
+        off += bW;
+        stream->writes++;
+    }
+    stream->bytes += size;
+}
+
+// write the buffer of a stream with a single write
+static void stream_flush(struct Stream *stream) {
+    stream_write(stream, stream->buffer, stream->used);
+    stream->used = 0;
+}
+
+// the last component of a path
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return (slash == NULL)? path : slash + 1;
+}
+
+static void stream_open(struct Demux *demux, int fileId) {
+    struct Stream *stream = &demux->streams[fileId];
+    const char *name = base_name(demux->names[fileId]);
+
+    // two input files may have the same name: the later ones get their id as suffix
+    int suffix = 0;
+    for (int i = 0; i < fileId && !suffix; ++i)
+        suffix = (strcmp(base_name(demux->names[i]), name) == 0);
+
+    char path[PATH_MAX];
+    if (suffix)
+        snprintf(path, sizeof(path), "%s/%s.%d", demux->outDir, name, fileId);
+    else
+        snprintf(path, sizeof(path), "%s/%s", demux->outDir, name);
+
+    stream->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (stream->fd == -1)
+        errExit("open output file failed");
+    stream->buffer = malloc(STREAM_BYTES);
+    if (stream->buffer == NULL)
+        errExit("malloc failed");
+    stream->state = STREAM_OPEN;
+}
+
+static void stream_close(struct Stream *stream, int state) {
+    if (stream->fd != -1) {
+        stream_flush(stream);
+        if (close(stream->fd) == -1)
+            errExit("close output file failed");
+    }
+    free(stream->buffer);
+    stream->buffer = NULL;
+    stream->fd = -1;
+    stream->state = state;
+}
+
+int demux_item(struct Demux *demux, const struct ItemHeader *header, const char *value) {
+    if (header->fileId >= (uint32_t) demux->nFiles)
+        return -1;
+
+    struct Stream *stream = &demux->streams[header->fileId];
+    if (stream->state == STREAM_BROKEN)
+        return -1;
+    if (stream->state == STREAM_DONE || header->seq != stream->nextSeq) {
+        stream_close(stream, STREAM_BROKEN);
+        return -1;
+    }
+    if (stream->state == STREAM_NEW)
+        stream_open(demux, header->fileId);
+    stream->nextSeq++;
+
+    if (header->flags & ITEM_LAST) {
+        stream_close(stream, STREAM_DONE);
+        return 0;
+    }
+
+    // values are gathered in the stream buffer, and written in large blocks
+    if (stream->used + header->rawSize > STREAM_BYTES)
+        stream_flush(stream);
+    // a value larger than the buffer (-c above STREAM_BYTES) is written as it is
+    if (header->rawSize > STREAM_BYTES) {
+        stream_write(stream, value, header->rawSize);
+        return 0;
+    }
+    memcpy(stream->buffer + stream->used, value, header->rawSize);
+    stream->used += header->rawSize;
+    return 0;
+}
+
+int demux_finish(struct Demux *demux) {
+    int complete = 0;
+    unsigned long long bytes = 0;
+    unsigned long writes = 0;
+
+    for (int i = 0; i < demux->nFiles; ++i) {
+        struct Stream *stream = &demux->streams[i];
+        if (stream->state == STREAM_OPEN || stream->state == STREAM_NEW) {
+            printf("<Consumer> %s is incomplete\n", demux->names[i]);
+            stream_close(stream, STREAM_BROKEN);
+        } else if (stream->state == STREAM_BROKEN)
+            printf("<Consumer> %s is broken: its Items are missing or out of order\n",
+                   demux->names[i]);
+        else
+            complete++;
+        bytes += stream->bytes;
+        writes += stream->writes;
+    }
+
+    printf("<Consumer> %d of %d files rebuilt in %s: %llu bytes with %lu writes\n",
+           complete, demux->nFiles, demux->outDir, bytes, writes);
+
+    free(demux->streams);
+    demux->streams = NULL;
+    return complete;
+}
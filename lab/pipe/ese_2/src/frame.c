@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "frame.h"
+#include "ring.h"
+#include "errExit.h"
+
+void batch_init(struct FrameBatch *batch, int fd, size_t capacity) {
+    batch->fd = fd;
+    batch->shared = NULL;
+    batch->used = 0;
+    batch->capacity = capacity;
+    batch->buffer = malloc(capacity);
+    if (batch->buffer == NULL)
+        errExit("batch malloc failed");
+}
+
+void batch_init_ring(struct FrameBatch *batch, struct ItemRing *ring, size_t capacity) {
+    batch_init(batch, -1, capacity);
+    batch->shared = ring;
+}
+
+void batch_flush(struct FrameBatch *batch) {
+    // the ring publishes the batch as a single block, as an atomic write
+    if (batch->shared != NULL) {
+        if (batch->used > 0)
+            ring_write(batch->shared, batch->buffer, batch->used);
+        batch->used = 0;
+        return;
+    }
+
+    // a write of at most PIPE_BUF bytes is atomic: it is never split,
+    // nor mixed with the bytes written by other producers.
+    // A bigger batch (single producer pipe) may be written partially
+    for (size_t off = 0; off < batch->used; ) {
+        ssize_t bW = write(batch->fd, batch->buffer + off, batch->used - off);
+        if (bW == -1) {
+            if (errno == EINTR)
+                continue;
+            errExit("batch write failed");
+        }
+        off += bW;
+    }
+
+    batch->used = 0;
+}
+
+void batch_add(struct FrameBatch *batch, const struct ItemHeader *header, const char *value) {
+    size_t frameSize = sizeof(*header) + header->size;
+
+    // no room for the Item: send the Items packed so far
+    if (batch->used + frameSize > batch->capacity)
+        batch_flush(batch);
+
+    memcpy(batch->buffer + batch->used, header, sizeof(*header));
+    if (header->size > 0)
+        memcpy(batch->buffer + batch->used + sizeof(*header), value, header->size);
+    batch->used += frameSize;
+}
+
+void batch_free(struct FrameBatch *batch) {
+    free(batch->buffer);
+    batch->buffer = NULL;
+}
+
+void parser_init(struct FrameParser *parser, int fd, size_t maxValue) {
+    // the ring must hold at least two max frames, so reads stay large
+    size_t capacity = RING_BYTES;
+    while (capacity < 2 * (sizeof(struct ItemHeader) + maxValue))
+        capacity <<= 1;
+
+    parser->fd = fd;
+    parser->shared = NULL;
+    parser->head = 0;
+    parser->tail = 0;
+    parser->capacity = capacity;
+    parser->reads = 0;
+    parser->ring = malloc(capacity);
+    if (parser->ring == NULL)
+        errExit("parser malloc failed");
+}
+
+void parser_init_ring(struct FrameParser *parser, struct ItemRing *ring, size_t maxValue) {
+    parser_init(parser, -1, maxValue);
+    parser->shared = ring;
+}
+
+size_t parser_pending(const struct FrameParser *parser) {
+    return parser->tail - parser->head;
+}
+
+int parser_full(const struct FrameParser *parser) {
+    return parser_pending(parser) == parser->capacity;
+}
+
+void parser_free(struct FrameParser *parser) {
+    free(parser->ring);
+    parser->ring = NULL;
+}
+
+ssize_t parser_fill(struct FrameParser *parser) {
+    size_t free = parser->capacity - parser_pending(parser);
+
+    // the free space of the ring buffer may wrap around its end:
+    // readv fills both segments with a single system call
+    size_t start = parser->tail & (parser->capacity - 1);
+    size_t first = parser->capacity - start;
+    if (first > free)
+        first = free;
+
+    struct iovec iov[2] = {
+        {.iov_base = parser->ring + start, .iov_len = first},
+        {.iov_base = parser->ring,         .iov_len = free - first}
+    };
+
+    ssize_t rB;
+    if (parser->shared != NULL)
+        rB = ring_readv(parser->shared, iov, (free > first)? 2 : 1);
+    else do {
+        rB = readv(parser->fd, iov, (free > first)? 2 : 1);
+    } while (rB == -1 && errno == EINTR);
+
+    if (rB > 0) {
+        parser->tail += rB;
+        parser->reads++;
+    }
+    return rB;
+}
+
+// copy n bytes starting at offset off of the ring buffer, handling the wrap around
+static void ring_copy(const struct FrameParser *parser, size_t off, void *dst, size_t n) {
+    size_t start = off & (parser->capacity - 1);
+    size_t first = parser->capacity - start;
+    if (first > n)
+        first = n;
+    memcpy(dst, parser->ring + start, first);
+    memcpy((char *) dst + first, parser->ring, n - first);
+}
+
+int parser_next(struct FrameParser *parser, struct ItemHeader *header,
+                char *value, size_t maxValue) {
+    size_t pending = parser_pending(parser);
+    if (pending < sizeof(*header))
+        return 0;
+
+    // peek the header: the frame may be still incomplete
+    ring_copy(parser, parser->head, header, sizeof(*header));
+    if (header->flags & ITEM_LAST) {
+        if (header->size != 0 || header->rawSize != 0)
+            return -1;
+    } else if (header->size <= 0 || (size_t) header->size > maxValue ||
+               header->rawSize == 0 || header->rawSize > maxValue)
+        return -1;
+
+    if (pending < sizeof(*header) + header->size)
+        return 0;
+
+    ring_copy(parser, parser->head + sizeof(*header), value, header->size);
+    parser->head += sizeof(*header) + header->size;
+    return 1;
+}
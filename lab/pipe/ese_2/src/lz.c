@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "lz.h"
+
+// size of the hash table of the recent positions
+#define HASH_BITS 12
+#define HASH_SIZE (1 << HASH_BITS)
+
+static inline uint32_t read32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// count the equal bytes of a and b, up to limit: 8 bytes at a time, then
+// the first different byte is found with the trailing zeros of the xor
+// (the loads are little-endian on x86 and arm)
+static inline size_t match_length(const char *a, const char *b, size_t limit) {
+    size_t len = 0;
+    while (len + 8 <= limit) {
+        uint64_t diff = read64(a + len) ^ read64(b + len);
+        if (diff != 0)
+            return len + (__builtin_ctzll(diff) >> 3);
+        len += 8;
+    }
+    while (len < limit && a[len] == b[len])
+        len++;
+    return len;
+}
+
+static inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// write a length bigger than 14 as a sequence of 255s and a last byte
+static inline char *write_length(char *op, const char *opEnd, size_t len) {
+    while (len >= 255) {
+        if (op >= opEnd)
+            return NULL;
+        *op++ = (char) 255;
+        len -= 255;
+    }
+    if (op >= opEnd)
+        return NULL;
+    *op++ = (char) len;
+    return op;
+}
+
+// emit a sequence: literals [lit, lit + litLen), then a match (if matchLen > 0)
+static char *write_sequence(char *op, const char *opEnd, const char *lit, size_t litLen,
+                            size_t offset, size_t matchLen) {
+    if (op >= opEnd)
+        return NULL;
+
+    char *token = op++;
+    size_t m = (matchLen > 0)? matchLen - LZ_MIN_MATCH : 0;
+    *token = (char) (((litLen < 15)? litLen : 15) << 4 | ((m < 15)? m : 15));
+
+    if (litLen >= 15 && (op = write_length(op, opEnd, litLen - 15)) == NULL)
+        return NULL;
+    if ((size_t) (opEnd - op) < litLen)
+        return NULL;
+    memcpy(op, lit, litLen);
+    op += litLen;
+
+    if (matchLen == 0)
+        return op;
+
+    if (opEnd - op < 2)
+        return NULL;
+    *op++ = (char) (offset & 0xff);
+    *op++ = (char) (offset >> 8);
+    if (m >= 15 && (op = write_length(op, opEnd, m - 15)) == NULL)
+        return NULL;
+    return op;
+}
+
+size_t lz_compress(const char *src, size_t srcLen, char *dst, size_t dstCap) {
+    // positions (+1) of the last occurrence of each hashed 4 bytes; 0: none
+    uint32_t table[HASH_SIZE];
+    memset(table, 0, sizeof(table));
+
+    const char *opEnd = dst + dstCap;
+    char *op = dst;
+    size_t ip = 0, anchor = 0;
+    // the step grows while no match is found, so incompressible data is skipped fast
+    unsigned int misses = 0;
+
+    while (srcLen >= LZ_MIN_MATCH && ip <= srcLen - LZ_MIN_MATCH) {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = hash32(seq);
+        size_t ref = table[h];
+        table[h] = (uint32_t) ip + 1;
+
+        if (ref == 0 || ip - (ref - 1) > LZ_MAX_OFFSET || read32(src + ref - 1) != seq) {
+            ip += 1 + (misses++ >> 5);
+            continue;
+        }
+        ref--;
+        misses = 0;
+
+        // extend the match forward
+        size_t len = LZ_MIN_MATCH + match_length(src + ref + LZ_MIN_MATCH, src + ip + LZ_MIN_MATCH,
+                                                 srcLen - ip - LZ_MIN_MATCH);
+
+        op = write_sequence(op, opEnd, src + anchor, ip - anchor, ip - ref, len);
+        if (op == NULL)
+            return 0;
+
+        ip += len;
+        anchor = ip;
+    }
+
+    // the last literals
+    op = write_sequence(op, opEnd, src + anchor, srcLen - anchor, 0, 0);
+    return (op == NULL)? 0 : (size_t) (op - dst);
+}
+
+// read a length extension: a sequence of 255s and a last byte
+static inline const char *read_length(const char *ip, const char *ipEnd, size_t *len) {
+    unsigned char b;
+    do {
+        if (ip >= ipEnd)
+            return NULL;
+        b = (unsigned char) *ip++;
+        *len += b;
+    } while (b == 255);
+    return ip;
+}
+
+long lz_decompress(const char *src, size_t srcLen, char *dst, size_t dstCap) {
+    const char *ip = src, *ipEnd = src + srcLen;
+    char *op = dst, *opEnd = dst + dstCap;
+
+    while (ip < ipEnd) {
+        unsigned char token = (unsigned char) *ip++;
+
+        size_t litLen = token >> 4;
+        if (litLen == 15 && (ip = read_length(ip, ipEnd, &litLen)) == NULL)
+            return -1;
+        if ((size_t) (ipEnd - ip) < litLen || (size_t) (opEnd - op) < litLen)
+            return -1;
+        memcpy(op, ip, litLen);
+        ip += litLen;
+        op += litLen;
+
+        // the last sequence has no match
+        if (ip == ipEnd)
+            break;
+
+        if (ipEnd - ip < 2)
+            return -1;
+        size_t offset = (unsigned char) ip[0] | ((size_t) (unsigned char) ip[1] << 8);
+        ip += 2;
+
+        size_t matchLen = token & 15;
+        if (matchLen == 15 && (ip = read_length(ip, ipEnd, &matchLen)) == NULL)
+            return -1;
+        matchLen += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t) (op - dst) || (size_t) (opEnd - op) < matchLen)
+            return -1;
+
+        // the match may overlap the bytes being written: copy byte by byte
+        // if it is closer than its length
+        const char *match = op - offset;
+        if (offset >= matchLen)
+            memcpy(op, match, matchLen);
+        else
+            for (size_t i = 0; i < matchLen; ++i)
+                op[i] = match[i];
+        op += matchLen;
+    }
+
+    return (long) (op - dst);
+}
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "lz.h"
+#include "errExit.h"
+
+// lzbench measures the lz codec used by the producers (-z) on a set of files:
+// each file is split in chunks as a producer does, and every chunk is
+// compressed (or kept raw, if incompressible) and decompressed again
+
+static double now_s (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// read a whole file in memory
+static char *load_file (const char *filename, size_t *size) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        errExit("open failed");
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        errExit("fstat failed");
+
+    char *data = malloc(st.st_size + 1);
+    if (data == NULL)
+        errExit("malloc failed");
+
+    size_t off = 0;
+    ssize_t bR;
+    while (off < (size_t) st.st_size && (bR = read(fd, data + off, st.st_size - off)) > 0)
+        off += bR;
+
+    if (close(fd) == -1)
+        errExit("close failed");
+    *size = off;
+    return data;
+}
+
+static void bench_file (const char *filename, size_t chunkBytes, int repeats) {
+    size_t size;
+    char *data = load_file(filename, &size);
+    size_t nChunks = (size + chunkBytes - 1) / chunkBytes;
+
+    // the compressed chunks, and their sizes (0: sent raw)
+    char *packed = malloc(nChunks * chunkBytes + 1);
+    size_t *packedSize = calloc(nChunks + 1, sizeof(size_t));
+    char *unpacked = malloc(chunkBytes);
+    if (packed == NULL || packedSize == NULL || unpacked == NULL)
+        errExit("malloc failed");
+
+    double compressTime = 0, decompressTime = 0;
+    size_t wireBytes = 0, rawChunks = 0;
+    for (int r = 0; r < repeats; ++r) {
+        double start = now_s();
+        for (size_t c = 0; c < nChunks; ++c) {
+            size_t len = (c == nChunks - 1)? size - c * chunkBytes : chunkBytes;
+            packedSize[c] = lz_compress(data + c * chunkBytes, len,
+                                        packed + c * chunkBytes, len - 1);
+        }
+        compressTime += now_s() - start;
+
+        start = now_s();
+        for (size_t c = 0; c < nChunks; ++c) {
+            if (packedSize[c] == 0)
+                continue;
+            size_t len = (c == nChunks - 1)? size - c * chunkBytes : chunkBytes;
+            long res = lz_decompress(packed + c * chunkBytes, packedSize[c], unpacked, chunkBytes);
+            if (res != (long) len || memcmp(unpacked, data + c * chunkBytes, len) != 0) {
+                printf("<lzbench> %s: chunk %zu does not decompress correctly\n", filename, c);
+                exit(1);
+            }
+        }
+        decompressTime += now_s() - start;
+    }
+
+    for (size_t c = 0; c < nChunks; ++c) {
+        size_t len = (c == nChunks - 1)? size - c * chunkBytes : chunkBytes;
+        wireBytes += (packedSize[c] > 0)? packedSize[c] : len;
+        rawChunks += (packedSize[c] == 0);
+    }
+
+    // the decompression speed is meaningful only if some chunk was compressed
+    double mb = (double) size * repeats / 1e6;
+    char decompressSpeed[32] = "-";
+    if (rawChunks < nChunks && decompressTime > 0)
+        snprintf(decompressSpeed, sizeof(decompressSpeed), "%.1f", mb / decompressTime);
+    printf("%-32s %12zu %12zu %7.1f%% %8zu %10.1f %10s\n", filename, size, wireBytes,
+           (size > 0)? 100.0 * wireBytes / size : 0, rawChunks,
+           (compressTime > 0)? mb / compressTime : 0, decompressSpeed);
+
+    free(data);
+    free(packed);
+    free(packedSize);
+    free(unpacked);
+}
+
+int main (int argc, char *argv[]) {
+    size_t chunkBytes = 65536;
+    int repeats = 5, opt;
+    while ((opt = getopt(argc, argv, "c:r:")) != -1) {
+        switch (opt) {
+            case 'c': chunkBytes = strtoul(optarg, NULL, 10); break;
+            case 'r': repeats = atoi(optarg); break;
+            default:
+                printf("Usage: %s [-c chunkBytes] [-r repeats] file1 ... fileN\n", argv[0]);
+                return 0;
+        }
+    }
+
+    if (optind == argc || chunkBytes < 2 || repeats <= 0) {
+        printf("Usage: %s [-c chunkBytes] [-r repeats] file1 ... fileN\n", argv[0]);
+        return 0;
+    }
+
+    printf("%-32s %12s %12s %8s %8s %10s %10s\n", "file", "bytes", "in pipe",
+           "ratio", "raw", "comp MB/s", "dec MB/s");
+    for (int i = optind; i < argc; ++i)
+        bench_file(argv[i], chunkBytes, repeats);
+    return 0;
+}
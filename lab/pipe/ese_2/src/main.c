@@ -1,42 +1,145 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
-#include <sys/wait.h>
+#include <getopt.h>
+#include <time.h>
 
-#include "consumer.h"
-#include "producer.h"
+#include "pipeline.h"
 #include "errExit.h"
 
+static void usage (const char *prog) {
+    printf("Usage: %s [-e] [-w workers] [-q quantum] [-c chunkBytes] [-z] [-u] [-o outDir] [--words K] [--shards N] [--count-only] [--flush-bytes N] [--flush-count N] textFile|dir ...\n", prog);
+    printf("  -e  one pipe per producer, multiplexed by the consumer with epoll\n");
+    printf("  -w  number of producers (default: number of cores)\n");
+    printf("  -q  max Items served per producer at each wake up (with -e)\n");
+    printf("  -c  max bytes of an Item (more than PIPE_BUF only with -e)\n");
+    printf("  -z  compress the Items (incompressible ones are sent raw)\n");
+    printf("  -u  read the files with io_uring, many blocks at a time\n");
+    printf("  -o  rebuild each file in outDir instead of printing its Items\n");
+    printf("  --words        count the words, and print the K most frequent ones\n");
+    printf("  --shards       word counting threads (default: number of cores)\n");
+    printf("  --count-only   no output: only report bytes, chunks and elapsed time\n");
+    printf("  --flush-bytes  write the Items when so many bytes are pending\n");
+    printf("  --flush-count  write the Items when so many slices are pending\n");
+}
+
 int main (int argc, char *argv[]) {
 
     // Check command line input arguments.
-    if (argc == 1) {
-        printf("Usage: %s textFile1 ... textFileN\n", argv[0]);
+    struct ConsumerConfig config = {
+        .chunkBytes = MSG_BYTES, .quantum = 16,
+        .output = {.countOnly = 0, .flushBytes = FLUSH_BYTES, .flushCount = FLUSH_COUNT},
+        .outDir = NULL, .topWords = 0, .wordShards = 0
+    };
+    const struct option longOptions[] = {
+        {"count-only",  no_argument,       NULL, 'C'},
+        {"flush-bytes", required_argument, NULL, 'B'},
+        {"flush-count", required_argument, NULL, 'N'},
+        {"words",       required_argument, NULL, 'W'},
+        {"shards",      required_argument, NULL, 'S'},
+        {NULL, 0, NULL, 0}
+    };
+    struct ProducerConfig producerConfig = {.compress = 0, .uring = 0};
+    int useEpoll = 0, nWorkers = default_workers(), opt;
+    while ((opt = getopt_long(argc, argv, "ew:q:c:zuo:", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'e':
+                useEpoll = 1;
+                break;
+            case 'w':
+                nWorkers = atoi(optarg);
+                break;
+            case 'q':
+                config.quantum = atoi(optarg);
+                break;
+            case 'c':
+                config.chunkBytes = strtoul(optarg, NULL, 10);
+                break;
+            case 'z':
+                producerConfig.compress = 1;
+                break;
+            case 'u':
+                producerConfig.uring = 1;
+                break;
+            case 'o':
+                config.outDir = optarg;
+                break;
+            case 'C':
+                config.output.countOnly = 1;
+                break;
+            case 'B':
+                config.output.flushBytes = strtoul(optarg, NULL, 10);
+                break;
+            case 'N':
+                config.output.flushCount = atoi(optarg);
+                break;
+            case 'W':
+                config.topWords = atoi(optarg);
+                break;
+            case 'S':
+                config.wordShards = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 0;
+        }
+    }
+
+    if (optind == argc || config.quantum <= 0 || config.chunkBytes == 0 || nWorkers <= 0 ||
+        config.output.flushBytes == 0 || config.output.flushCount <= 0 ||
+        config.topWords < 0 || config.wordShards < 0) {
+        usage(argv[0]);
         return 0;
     }
 
-    int pipeFD[2];
-
-    // Make a new PIPE
-    if((pipe(pipeFD)) == -1)
-	errExit("pipe failed");
-
-    // Generate a sub process reading a text file token-by-token
-    printf("<Consumer> making %d subprocesses...\n", (argc - 1));
-    for (int i = 0; i < (argc - 1); ++i) {
-        pid_t pid = fork();
-        if (pid == -1)
-            printf("Fork failed. The file %s will not be read!\n", argv[1 + i]);
-        else if (pid == 0) {
-            producer(pipeFD, argv[1 + i]);
-            _exit(0);
-        }
+    if (config.topWords > 0 && config.outDir != NULL) {
+        printf("The words can not be counted while the files are rebuilt (-o)\n");
+        return 0;
     }
 
-    // run the consumer process, which reads the pipe
-    consumer(pipeFD);
+    if (pipeline_check(&config, useEpoll) == -1)
+        return 0;
+
+    // collect the input files: the id of a file is its position in the list
+    struct FileList files = {NULL, 0, 0};
+    for (int i = optind; i < argc; ++i)
+        if (filelist_add(&files, argv[i]) == -1)
+            printf("%s does not exist. It will not be read!\n", argv[i]);
+    if (files.count == 0) {
+        printf("<Consumer> there are no files to read\n");
+        return 0;
+    }
+    config.files = files.names;
+    config.nFiles = files.count;
+
+    // the files are tokenized in parallel by the shards: a file belongs
+    // to a single shard, so more shards than files would be idle
+    if (config.wordShards == 0)
+        config.wordShards = default_workers();
+    if (config.wordShards > files.count)
+        config.wordShards = files.count;
+
+    // the producers take the files from a shared queue: more producers
+    // than files would have nothing to do
+    if (nWorkers > files.count)
+        nWorkers = files.count;
+    struct WorkQueue *queue = workqueue_create(files.count, nWorkers);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    producerConfig.chunkBytes = config.chunkBytes;
+    struct Pipeline pipeline = {
+        .config = &config, .producerConfig = &producerConfig, .files = files.names,
+        .queue = queue, .nWorkers = nWorkers, .useEpoll = useEpoll
+    };
+    pipeline_run(&pipeline);
 
-    // wait the termination of all child process.
-    while (wait(NULL) != -1);
+    // the producers wrote their stats in the shared queue
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    workqueue_summary(queue, (uint64_t) (end.tv_sec - start.tv_sec) * 1000000000ull +
+                             end.tv_nsec - start.tv_nsec);
+    workqueue_destroy(queue);
+    filelist_free(&files);
 
 }
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "pool.h"
+#include "errExit.h"
+
+static void filelist_push(struct FileList *list, const char *path) {
+    if (list->count == list->capacity) {
+        list->capacity = (list->capacity == 0)? 64 : 2 * list->capacity;
+        list->names = realloc(list->names, list->capacity * sizeof(char *));
+        if (list->names == NULL)
+            errExit("realloc failed");
+    }
+    list->names[list->count] = strdup(path);
+    if (list->names[list->count] == NULL)
+        errExit("strdup failed");
+    list->count++;
+}
+
+// add the regular files found under the directory path
+static int filelist_walk(struct FileList *list, const char *path) {
+    struct dirent **entries;
+    int n = scandir(path, &entries, NULL, alphasort);
+    if (n == -1) {
+        printf("<Consumer> can not read the directory %s\n", path);
+        return 0;
+    }
+
+    int added = 0;
+    for (int i = 0; i < n; ++i) {
+        const char *name = entries[i]->d_name;
+        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+            char child[PATH_MAX];
+            if (snprintf(child, sizeof(child), "%s/%s", path, name) < (int) sizeof(child)) {
+                int res = filelist_add(list, child);
+                if (res > 0)
+                    added += res;
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return added;
+}
+
+int filelist_add(struct FileList *list, const char *path) {
+    struct stat info;
+    if (lstat(path, &info) == -1)
+        return -1;
+
+    if (S_ISDIR(info.st_mode))
+        return filelist_walk(list, path);
+
+    // a link is added only if it points to a regular file
+    if (S_ISLNK(info.st_mode) && stat(path, &info) == -1)
+        return 0;
+    if (!S_ISREG(info.st_mode))
+        return 0;
+
+    filelist_push(list, path);
+    return 1;
+}
+
+void filelist_free(struct FileList *list) {
+    for (int i = 0; i < list->count; ++i)
+        free(list->names[i]);
+    free(list->names);
+    list->names = NULL;
+    list->count = list->capacity = 0;
+}
+
+struct WorkQueue *workqueue_create(uint32_t nFiles, int nWorkers) {
+    size_t size = sizeof(struct WorkQueue) + nWorkers * sizeof(struct WorkerStats);
+    struct WorkQueue *queue = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (queue == MAP_FAILED)
+        errExit("mmap failed");
+
+    // an anonymous mapping is already zeroed
+    queue->nFiles = nFiles;
+    queue->nWorkers = nWorkers;
+    queue->mappingSize = size;
+    return queue;
+}
+
+long workqueue_take(struct WorkQueue *queue) {
+    uint32_t index = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+    return (index < queue->nFiles)? (long) index : -1;
+}
+
+void workqueue_summary(const struct WorkQueue *queue, uint64_t elapsedNs) {
+    unsigned long files = 0, failed = 0;
+    unsigned long long bytes = 0;
+
+    for (int i = 0; i < queue->nWorkers; ++i) {
+        const struct WorkerStats *stats = &queue->stats[i];
+        double busy = stats->busyNs / 1e9;
+        printf("<Consumer> producer %d: %lu files, %llu bytes in %.3f s (%.1f MB/s)\n",
+               i, stats->files, stats->bytes, busy,
+               (busy > 0)? stats->bytes / busy / 1e6 : 0);
+        files += stats->files;
+        failed += stats->failed;
+        bytes += stats->bytes;
+    }
+
+    double elapsed = elapsedNs / 1e9;
+    printf("<Consumer> %d producers: %lu files (%lu failed), %llu bytes in %.3f s "
+           "(%.1f MB/s, %.1f files/s)\n",
+           queue->nWorkers, files, failed, bytes, elapsed,
+           (elapsed > 0)? bytes / elapsed / 1e6 : 0,
+           (elapsed > 0)? files / elapsed : 0);
+}
+
+void workqueue_destroy(struct WorkQueue *queue) {
+    if (munmap(queue, queue->mappingSize) == -1)
+        errExit("munmap failed");
+}
+
+int default_workers(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0)? (int) cores : 1;
+}
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "pipeline.h"
+#include "frame.h"
+#include "errExit.h"
+
+// the producers are child processes, writing to pipes
+
+int pipeline_check(const struct ConsumerConfig *config, int useEpoll) {
+    // a shared pipe needs atomic batches: a frame can not exceed PIPE_BUF
+    size_t frameBytes = sizeof(struct ItemHeader) + config->chunkBytes;
+    if (!useEpoll && frameBytes > PIPE_BUF) {
+        printf("Items bigger than %d bytes need a pipe per producer (-e)\n",
+               (int) (PIPE_BUF - sizeof(struct ItemHeader)));
+        return -1;
+    }
+    return 0;
+}
+
+void pipeline_run(struct Pipeline *pipeline) {
+    struct ProducerConfig *producerConfig = pipeline->producerConfig;
+    struct WorkQueue *queue = pipeline->queue;
+    int nWorkers = pipeline->nWorkers;
+    producerConfig->batchBytes = PIPE_BUF;
+
+    // the children must not inherit the messages buffered so far
+    printf("<Consumer> making %d subprocesses for %u files...\n", nWorkers, queue->nFiles);
+    fflush(stdout);
+
+    if (!pipeline->useEpoll) {
+        int pipeFD[2];
+
+        // Make a new PIPE
+        if((pipe(pipeFD)) == -1)
+	    errExit("pipe failed");
+
+        // Generate the pool of producers: if a fork fails, the other
+        // producers read its files
+        for (int i = 0; i < nWorkers; ++i) {
+            pid_t pid = fork();
+            if (pid == -1)
+                printf("Fork failed. The producer %d will not run!\n", i);
+            else if (pid == 0) {
+                producer(pipeFD, queue, i, pipeline->files, producerConfig);
+                _exit(0);
+            }
+        }
+
+        // run the consumer process, which reads the pipe
+        consumer(pipeFD, pipeline->config);
+    } else {
+        // each producer has its own pipe: the consumer keeps a read end for
+        // each producer, so raise the limit of open files if it is too low
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+
+        size_t frameBytes = sizeof(struct ItemHeader) + pipeline->config->chunkBytes;
+        producerConfig->batchBytes = (frameBytes > BATCH_BYTES)? frameBytes : BATCH_BYTES;
+        int *readFDs = malloc(nWorkers * sizeof(int));
+        char **names = malloc(nWorkers * sizeof(char *));
+        if (readFDs == NULL || names == NULL)
+            errExit("malloc failed");
+
+        int nSources = 0;
+        for (int i = 0; i < nWorkers; ++i) {
+            int pipeFD[2];
+            if (pipe(pipeFD) == -1)
+                errExit("pipe failed");
+
+            pid_t pid = fork();
+            if (pid == -1) {
+                printf("Fork failed. The producer %d will not run!\n", i);
+                close(pipeFD[0]);
+                close(pipeFD[1]);
+                continue;
+            } else if (pid == 0) {
+                // the child does not need the read ends of the other producers
+                for (int j = 0; j < nSources; ++j)
+                    close(readFDs[j]);
+                producer(pipeFD, queue, i, pipeline->files, producerConfig);
+                _exit(0);
+            }
+
+            // only the producer keeps the write end: the consumer sees
+            // end-of-file as soon as the producer terminates
+            if (close(pipeFD[1]) == -1)
+                errExit("close failed");
+            readFDs[nSources] = pipeFD[0];
+            names[nSources] = malloc(32);
+            if (names[nSources] == NULL)
+                errExit("malloc failed");
+            snprintf(names[nSources], 32, "producer %d", i);
+            nSources++;
+        }
+
+        // run the consumer process, which multiplexes the pipes
+        consumer_epoll(readFDs, names, nSources, pipeline->config);
+
+        for (int i = 0; i < nSources; ++i)
+            free(names[i]);
+        free(readFDs);
+        free(names);
+    }
+
+    // wait the termination of all child process.
+    while (wait(NULL) != -1);
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/types.h>
@@ -7,54 +8,165 @@
 #include <fcntl.h>
 
 #include "producer.h"
+#include "frame.h"
+#include "lz.h"
+#include "pool.h"
+#include "uring.h"
 #include "errExit.h"
 
-
-#define MSG_BYTES 100
-
-struct Item {
-    ssize_t size;
-    char value [MSG_BYTES];
+// the buffers a producer reuses for all its files
+struct ProducerState {
+    struct FrameBatch *batch;   /* Items not sent yet                    */
+    char *buffer;               /* the bytes of a whole batch of Items   */
+    size_t bufferSize;
+    char *packed;               /* a compressed chunk                    */
+    int useUring;               /* 1: the file is read with io_uring     */
+    struct UringReader reader;  /* reads in flight (useUring)            */
 };
 
-void producer (int *pipeFD, const char *filename) {
-    // Close the read-end of the pipe
-    if (close(pipeFD[0]) == -1)
-	errExit("chiuso lettura - producer");
-
+static uint64_t now_ns (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
+// send the Items of a file, followed by its ITEM_LAST Item.
+// It returns the bytes read from the file, -1 if the file can not be opened
+static long long send_file (struct ProducerState *state, const char *filename,
+                            uint32_t fileId, const struct ProducerConfig *config) {
     printf("<Producer> text file: %s\n", filename);
 
     // Open the text file in read only mode
     int file = open(filename, O_RDONLY);
-    struct Item item;
+    if (file == -1) {
+        printf("<Producer> open of %s failed: the file will not be read!\n", filename);
+        return -1;
+    }
+
+    // each Item carries the file id and its position in the file,
+    // so the consumer can rebuild the file
+    size_t chunkBytes = config->chunkBytes;
+    long long total = 0;
+    uint32_t seq = 0;
+    ssize_t bR;
+    char *data = state->buffer;
+    if (state->useUring)
+        reader_start(&state->reader, file);
     do {
-        // read a chunk of bytes from file:
-        // copy in item.value a chunk of bytes from the file, and
-        // set item.size equal to the number of read bytes
-	item.size = read(file, item.value, MSG_BYTES);
-        if (item.size == -1)
+        // with io_uring the next blocks are already being read
+        if (state->useUring)
+            bR = reader_next(&state->reader, &data);
+        else
+            bR = read(file, data, state->bufferSize);
+        if (bR == -1)
             errExit("read failed");
+        total += bR;
 
-        if (item.size > 0) {
-            // What is the right size?
-            // (size of a ssize_t and the number of read chars)
-            ssize_t bytes2send = sizeof(ssize_t) + item.size;
-            // send struct item to Consumer through pipe
-            ssize_t bW = write(pipeFD[1], &item, bytes2send);
-            // check bW value
-            if(bW == -1)
-		errExit("write failed");
+        // split the read bytes in Items of at most chunkBytes bytes
+        for (ssize_t off = 0; off < bR; off += chunkBytes) {
+            ssize_t size = ((size_t) (bR - off) < chunkBytes)? bR - off : (ssize_t) chunkBytes;
+            struct ItemHeader header = {
+                .size = size, .flags = 0, .rawSize = size, .fileId = fileId, .seq = seq++
+            };
+            const char *value = data + off;
+
+            // an incompressible chunk (lz_compress returns 0) is sent raw
+            size_t packedSize = 0;
+            if (config->compress)
+                packedSize = lz_compress(value, size, state->packed, size - 1);
+            if (packedSize > 0) {
+                header.size = packedSize;
+                header.flags |= ITEM_COMPRESSED;
+                value = state->packed;
+            }
+            batch_add(state->batch, &header, value);
         }
-    } while (item.size > 0);
 
-    // Close the write end of the pipe
-    if ((close(pipeFD[1])) == -1)
-        errExit("chiuso scrittura - producer");
+        // the Items were copied in the batch: the block can be read again
+        if (state->useUring && bR > 0)
+            reader_release(&state->reader, -1, 0);
+    } while (bR > 0);
+
+    // the reads beyond the end of the file must complete before the close
+    if (state->useUring)
+        reader_stop(&state->reader);
+
+    // the last Item tells the consumer that the file is complete
+    struct ItemHeader last = {
+        .size = 0, .flags = ITEM_LAST, .rawSize = 0, .fileId = fileId, .seq = seq
+    };
+    batch_add(state->batch, &last, NULL);
 
     //Close file
     if(close(file) == -1)
 	errExit("chiusura file - producer");
+    return total;
+}
+
+void producer_loop (struct FrameBatch *batch, struct WorkQueue *queue, int worker,
+                    char **files, const struct ProducerConfig *config) {
+    struct ProducerState state;
+    size_t chunkBytes = config->chunkBytes;
+    state.batch = batch;
+
+    // read at once the bytes of a whole batch of Items
+    size_t itemsPerBatch = config->batchBytes / (sizeof(struct ItemHeader) + chunkBytes);
+    state.bufferSize = itemsPerBatch * chunkBytes;
+    state.buffer = malloc(state.bufferSize);
+    // a compressed chunk is sent only if it is smaller than the raw one
+    state.packed = malloc(chunkBytes);
+    if (state.buffer == NULL || state.packed == NULL)
+        errExit("malloc failed");
+
+    // io_uring reads URING_DEPTH blocks of the file at the same time
+    state.useUring = 0;
+    if (config->uring) {
+        if (reader_init(&state.reader, state.bufferSize, URING_DEPTH) == 0)
+            state.useUring = 1;
+        else
+            printf("<Producer> io_uring is not available: falling back to read\n");
+    }
+
+    // take files from the shared queue until all of them were taken
+    struct WorkerStats *stats = &queue->stats[worker];
+    long fileId;
+    while ((fileId = workqueue_take(queue)) != -1) {
+        uint64_t start = now_ns();
+        long long bytes = send_file(&state, files[fileId], (uint32_t) fileId, config);
+        stats->busyNs += now_ns() - start;
+        if (bytes == -1)
+            stats->failed++;
+        else {
+            stats->files++;
+            stats->bytes += bytes;
+        }
+    }
+
+    // send the last Items
+    batch_flush(batch);
+    free(state.buffer);
+    free(state.packed);
+    if (state.useUring)
+        reader_free(&state.reader);
+}
+
+void producer (int *pipeFD, struct WorkQueue *queue, int worker, char **files,
+               const struct ProducerConfig *config) {
+    // Close the read-end of the pipe
+    if (close(pipeFD[0]) == -1)
+	errExit("chiuso lettura - producer");
+
+    // the Items are packed in a batch, which is sent with a single write
+    // when it is full (or when the producer has no more files)
+    struct FrameBatch batch;
+    batch_init(&batch, pipeFD[1], config->batchBytes);
+    producer_loop(&batch, queue, worker, files, config);
+    batch_free(&batch);
+
+    // Close the write end of the pipe
+    if ((close(pipeFD[1])) == -1)
+        errExit("chiuso scrittura - producer");
 
-    return;
+    // the process ends with _exit: its messages must be written now
+    fflush(stdout);
 }
@@ -0,0 +1,138 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ring.h"
+#include "errExit.h"
+
+// tell the CPU that we are spinning
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+// the ring is used by the threads of a single process: private futexes are enough
+static void futex_wait(uint32_t *word, uint32_t value) {
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// a condition a thread waits for
+typedef int (*RingCondition)(struct ItemRing *ring, uint64_t arg);
+
+// there is room for the bytes up to end
+static int has_room(struct ItemRing *ring, uint64_t end) {
+    return end - __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) <= ring->capacity;
+}
+
+// the batches reserved before start have been published
+static int is_turn(struct ItemRing *ring, uint64_t start) {
+    return __atomic_load_n(&ring->commit, __ATOMIC_SEQ_CST) == start;
+}
+
+// there are published bytes, or no producer is left
+static int has_data(struct ItemRing *ring, uint64_t head) {
+    return __atomic_load_n(&ring->commit, __ATOMIC_SEQ_CST) != head ||
+           __atomic_load_n(&ring->open, __ATOMIC_SEQ_CST) == 0;
+}
+
+// wait until cond holds: spin for RING_SPIN iterations, then sleep on the
+// futex word, which is bumped each time the condition may change
+static void ring_wait(struct ItemRing *ring, RingCondition cond, uint64_t arg,
+                      uint32_t *word, uint32_t *waiters) {
+    for (int spins = 0; !cond(ring, arg); ++spins) {
+        if (spins < RING_SPIN) {
+            cpu_relax();
+            continue;
+        }
+        uint32_t seen = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+        if (!cond(ring, arg))
+            futex_wait(word, seen);
+        __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void ring_signal(uint32_t *word, uint32_t *waiters) {
+    __atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST) != 0)
+        futex_wake(word);
+}
+
+void ring_init(struct ItemRing *ring, size_t capacity, int nProducers) {
+    memset(ring, 0, sizeof(*ring));
+    ring->capacity = capacity;
+    ring->open = nProducers;
+    ring->buffer = malloc(capacity);
+    if (ring->buffer == NULL)
+        errExit("ring malloc failed");
+}
+
+void ring_write(struct ItemRing *ring, const void *data, size_t n) {
+    uint64_t start = __atomic_fetch_add(&ring->reserve, n, __ATOMIC_SEQ_CST);
+    uint64_t end = start + n;
+
+    // the reserved bytes may still hold bytes not consumed yet
+    ring_wait(ring, has_room, end, &ring->consumed, &ring->roomWaiters);
+
+    size_t off = start & (ring->capacity - 1);
+    size_t first = ring->capacity - off;
+    if (first > n)
+        first = n;
+    memcpy(ring->buffer + off, data, first);
+    memcpy(ring->buffer, (const char *) data + first, n - first);
+
+    // batches are published in the order they were reserved
+    ring_wait(ring, is_turn, start, &ring->published, &ring->publishWaiters);
+    __atomic_store_n(&ring->commit, end, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&ring->publishes, 1, __ATOMIC_RELAXED);
+    ring_signal(&ring->published, &ring->publishWaiters);
+}
+
+size_t ring_readv(struct ItemRing *ring, const struct iovec *iov, int iovcnt) {
+    uint64_t head = ring->head;
+    ring_wait(ring, has_data, head, &ring->published, &ring->publishWaiters);
+
+    size_t avail = __atomic_load_n(&ring->commit, __ATOMIC_ACQUIRE) - head;
+    size_t moved = 0;
+    for (int i = 0; i < iovcnt && moved < avail; ++i) {
+        size_t n = avail - moved;
+        if (n > iov[i].iov_len)
+            n = iov[i].iov_len;
+
+        size_t off = (head + moved) & (ring->capacity - 1);
+        size_t first = ring->capacity - off;
+        if (first > n)
+            first = n;
+        memcpy(iov[i].iov_base, ring->buffer + off, first);
+        memcpy((char *) iov[i].iov_base + first, ring->buffer, n - first);
+        moved += n;
+    }
+
+    // the room of the moved bytes can be reserved again
+    if (moved > 0) {
+        __atomic_store_n(&ring->head, head + moved, __ATOMIC_SEQ_CST);
+        ring_signal(&ring->consumed, &ring->roomWaiters);
+    }
+    return moved;
+}
+
+void ring_close(struct ItemRing *ring) {
+    __atomic_sub_fetch(&ring->open, 1, __ATOMIC_SEQ_CST);
+    ring_signal(&ring->published, &ring->publishWaiters);
+}
+
+void ring_free(struct ItemRing *ring) {
+    free(ring->buffer);
+    ring->buffer = NULL;
+}
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "pipeline.h"
+#include "frame.h"
+#include "ring.h"
+#include "errExit.h"
+
+// the producers are threads of the consumer's process, publishing their
+// batches to an ItemRing instead of writing them to a pipe
+
+// the ProducerThread structure is the argument of a producer thread
+struct ProducerThread {
+    pthread_t thread;
+    int worker;                     /* position in the pool                */
+    int started;                    /* 1 if the thread was created         */
+    struct Pipeline *pipeline;
+    struct ItemRing *ring;
+};
+
+static void *producer_thread (void *arg) {
+    struct ProducerThread *self = arg;
+    struct ProducerConfig *producerConfig = self->pipeline->producerConfig;
+
+    struct FrameBatch batch;
+    batch_init_ring(&batch, self->ring, producerConfig->batchBytes);
+    producer_loop(&batch, self->pipeline->queue, self->worker,
+                  self->pipeline->files, producerConfig);
+    batch_free(&batch);
+
+    // the consumer sees the end of the stream when all producers are closed
+    ring_close(self->ring);
+    return NULL;
+}
+
+int pipeline_check(const struct ConsumerConfig *config, int useEpoll) {
+    // the ring has no PIPE_BUF limit: a batch is always published as a whole
+    (void) config;
+    (void) useEpoll;
+    return 0;
+}
+
+void pipeline_run(struct Pipeline *pipeline) {
+    struct ProducerConfig *producerConfig = pipeline->producerConfig;
+    int nWorkers = pipeline->nWorkers;
+
+    if (pipeline->useEpoll)
+        printf("<Consumer> the producer threads share a single ring: -e and -q are ignored\n");
+
+    // the ring holds at least two batches, so a producer can fill a batch
+    // while the consumer reads the previous one
+    size_t frameBytes = sizeof(struct ItemHeader) + pipeline->config->chunkBytes;
+    producerConfig->batchBytes = (frameBytes > BATCH_BYTES)? frameBytes : BATCH_BYTES;
+    size_t capacity = ITEM_RING_BYTES;
+    while (capacity < 2 * producerConfig->batchBytes)
+        capacity <<= 1;
+
+    struct ItemRing ring;
+    ring_init(&ring, capacity, nWorkers);
+
+    struct ProducerThread *threads = calloc(nWorkers, sizeof(struct ProducerThread));
+    if (threads == NULL)
+        errExit("calloc failed");
+
+    printf("<Consumer> making %d threads for %u files...\n", nWorkers, pipeline->queue->nFiles);
+    for (int i = 0; i < nWorkers; ++i) {
+        threads[i].worker = i;
+        threads[i].pipeline = pipeline;
+        threads[i].ring = &ring;
+        // if a thread is not created, the other producers read its files
+        if (pthread_create(&threads[i].thread, NULL, producer_thread, &threads[i]) != 0) {
+            printf("Thread creation failed. The producer %d will not run!\n", i);
+            ring_close(&ring);
+        } else
+            threads[i].started = 1;
+    }
+
+    // run the consumer in the main thread, which reads the ring
+    struct FrameParser parser;
+    parser_init_ring(&parser, &ring, pipeline->config->chunkBytes);
+    consumer_run(&parser, pipeline->config);
+
+    // a corrupted stream stops the consumer early:
+    // the rest of the ring is discarded, so that the producers can finish
+    do
+        parser.head = parser.tail;
+    while (parser_fill(&parser) > 0);
+    parser_free(&parser);
+
+    for (int i = 0; i < nWorkers; ++i)
+        if (threads[i].started && pthread_join(threads[i].thread, NULL) != 0)
+            printf("<Consumer> join of the producer %d failed\n", i);
+
+    printf("<Consumer> %lu batches published in a ring of %zu bytes\n", ring.publishes, capacity);
+    ring_free(&ring);
+    free(threads);
+}
@@ -0,0 +1,488 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+#include "words.h"
+#include "errExit.h"
+
+// the header of an Item copied in a WordJob: len bytes of value follow it
+struct WordRecord {
+    uint32_t fileId;
+    uint32_t flags;
+    uint32_t len;
+};
+
+static int is_word_byte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+static uint64_t word_mask_scalar(const char *p, size_t n) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < n; ++i)
+        mask |= (uint64_t) is_word_byte((unsigned char) p[i]) << i;
+    return mask;
+}
+
+#ifdef HAVE_X86_SIMD
+// SSE2 has only signed compares: a range [lo, lo + len) is moved to the bottom
+// of the signed range, so 'c in range' becomes 'c + (0x80 - lo) < -128 + len'
+__attribute__((target("sse2")))
+static uint64_t word_mask_sse2(const char *p, size_t n) {
+    const __m128i lowerBase = _mm_set1_epi8((char) (0x80 - 'a'));
+    const __m128i digitBase = _mm_set1_epi8((char) (0x80 - '0'));
+    const __m128i lowerEnd = _mm_set1_epi8((char) (-128 + 26));
+    const __m128i digitEnd = _mm_set1_epi8((char) (-128 + 10));
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i zero = _mm_setzero_si128();
+
+    uint64_t mask = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (p + i));
+        // letters are folded to lower case, non ASCII bytes are negative
+        __m128i letter = _mm_cmpgt_epi8(lowerEnd, _mm_add_epi8(_mm_or_si128(c, caseBit), lowerBase));
+        __m128i digit = _mm_cmpgt_epi8(digitEnd, _mm_add_epi8(c, digitBase));
+        __m128i high = _mm_cmpgt_epi8(zero, c);
+        __m128i word = _mm_or_si128(_mm_or_si128(letter, digit), high);
+        mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(word) << i;
+    }
+    if (i < n)
+        mask |= word_mask_scalar(p + i, n - i) << i;
+    return mask;
+}
+
+// the same classifier on 32 bytes at a time
+__attribute__((target("avx2")))
+static uint64_t word_mask_avx2(const char *p, size_t n) {
+    const __m256i lowerBase = _mm256_set1_epi8((char) (0x80 - 'a'));
+    const __m256i digitBase = _mm256_set1_epi8((char) (0x80 - '0'));
+    const __m256i lowerEnd = _mm256_set1_epi8((char) (-128 + 26));
+    const __m256i digitEnd = _mm256_set1_epi8((char) (-128 + 10));
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    const __m256i zero = _mm256_setzero_si256();
+
+    uint64_t mask = 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *) (p + i));
+        __m256i letter = _mm256_cmpgt_epi8(lowerEnd, _mm256_add_epi8(_mm256_or_si256(c, caseBit), lowerBase));
+        __m256i digit = _mm256_cmpgt_epi8(digitEnd, _mm256_add_epi8(c, digitBase));
+        __m256i high = _mm256_cmpgt_epi8(zero, c);
+        __m256i word = _mm256_or_si256(_mm256_or_si256(letter, digit), high);
+        mask |= (uint64_t) (uint32_t) _mm256_movemask_epi8(word) << i;
+    }
+    if (i < n)
+        mask |= word_mask_sse2(p + i, n - i) << i;
+    return mask;
+}
+#endif
+
+// the kernel is chosen once, the first time word_mask is called
+static uint64_t (*kernel)(const char *, size_t) = NULL;
+static const char *kernelName = "scalar";
+
+static void select_kernel(void) {
+    kernel = word_mask_scalar;
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = word_mask_avx2;
+        kernelName = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernel = word_mask_sse2;
+        kernelName = "sse2";
+    }
+#endif
+}
+
+uint64_t word_mask(const char *p, size_t n) {
+    if (kernel == NULL)
+        select_kernel();
+    return kernel(p, n);
+}
+
+const char *word_kernel(void) {
+    if (kernel == NULL)
+        select_kernel();
+    return kernelName;
+}
+
+static void table_init(struct WordTable *table) {
+    table->capacity = WORD_TABLE_SLOTS;
+    table->used = 0;
+    table->slots = calloc(table->capacity, sizeof(struct WordSlot));
+    table->arenaCapacity = 64 * 1024;
+    table->arenaUsed = 0;
+    table->arena = malloc(table->arenaCapacity);
+    if (table->slots == NULL || table->arena == NULL)
+        errExit("malloc failed");
+}
+
+static void table_free(struct WordTable *table) {
+    free(table->slots);
+    free(table->arena);
+}
+
+// double the slots: the words keep their place in the arena
+static void table_grow(struct WordTable *table) {
+    size_t capacity = 2 * table->capacity;
+    struct WordSlot *slots = calloc(capacity, sizeof(struct WordSlot));
+    if (slots == NULL)
+        errExit("calloc failed");
+
+    for (size_t i = 0; i < table->capacity; ++i) {
+        struct WordSlot *slot = &table->slots[i];
+        if (slot->hash == 0)
+            continue;
+        size_t j = slot->hash & (capacity - 1);
+        while (slots[j].hash != 0)
+            j = (j + 1) & (capacity - 1);
+        slots[j] = *slot;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+}
+
+static void table_add(struct WordTable *table, const char *word, uint32_t len,
+                      uint64_t hash, uint64_t count) {
+    if ((table->used + 1) * 10 > table->capacity * 7)
+        table_grow(table);
+
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        struct WordSlot *slot = &table->slots[i];
+        if (slot->hash == hash && slot->len == len &&
+            memcmp(table->arena + slot->offset, word, len) == 0) {
+            slot->count += count;
+            return;
+        }
+        if (slot->hash == 0) {
+            if (table->arenaUsed + len > table->arenaCapacity) {
+                table->arenaCapacity *= 2;
+                table->arena = realloc(table->arena, table->arenaCapacity);
+                if (table->arena == NULL)
+                    errExit("realloc failed");
+            }
+            memcpy(table->arena + table->arenaUsed, word, len);
+            *slot = (struct WordSlot) {
+                .hash = hash, .count = count, .len = len, .offset = (uint32_t) table->arenaUsed
+            };
+            table->arenaUsed += len;
+            table->used++;
+            return;
+        }
+    }
+}
+
+// count a word: it is folded to lower case and hashed with FNV-1a
+static void emit_word(struct WordShard *shard, const char *word, size_t len) {
+    char lower[WORD_MAX];
+    if (len > WORD_MAX)
+        len = WORD_MAX;
+
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i) {
+        char c = word[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        lower[i] = c;
+        hash = (hash ^ (unsigned char) c) * 1099511628211ull;
+    }
+    // 0 marks the empty slots
+    if (hash == 0)
+        hash = 1;
+
+    table_add(&shard->table, lower, (uint32_t) len, hash, 1);
+    shard->tokens++;
+}
+
+// append bytes to the token cut at the end of the previous Item
+static void carry_append(struct WordCarry *carry, const char *data, size_t n) {
+    if (carry->len < WORD_MAX) {
+        size_t room = WORD_MAX - carry->len;
+        memcpy(carry->word + carry->len, data, (n < room)? n : room);
+    }
+    carry->len += n;
+}
+
+// find the words of n bytes of a file, 64 bytes at a time: each word is
+// found at the 0 -> 1 and 1 -> 0 transitions of the classifier masks
+static void tokenize(struct WordShard *shard, struct WordCarry *carry,
+                     const char *data, size_t n) {
+    int inWord = (carry->len > 0);
+    size_t start = 0;
+
+    for (size_t base = 0; base < n; base += 64) {
+        size_t len = (n - base < 64)? n - base : 64;
+        uint64_t valid = (len == 64)? ~0ull : (1ull << len) - 1;
+        uint64_t mask = word_mask(data + base, len);
+
+        unsigned bit = 0;
+        for (;;) {
+            // the next byte of the other class
+            uint64_t rest = (inWord? ~mask & valid : mask) >> bit << bit;
+            if (rest == 0)
+                break;
+            bit = __builtin_ctzll(rest);
+
+            size_t pos = base + bit;
+            if (!inWord)
+                start = pos;
+            else if (carry->len > 0) {
+                carry_append(carry, data, pos);
+                emit_word(shard, carry->word, carry->len);
+                carry->len = 0;
+            } else
+                emit_word(shard, data + start, pos - start);
+            inWord = !inWord;
+        }
+    }
+
+    // the last word may continue in the next Item
+    if (inWord)
+        carry_append(carry, data + start, n - start);
+}
+
+static void shard_item(struct WordShard *shard, const struct WordRecord *record,
+                       const char *value) {
+    struct WordCarry *carry = &shard->carries[record->fileId];
+    if (record->flags & ITEM_LAST) {
+        if (carry->len > 0)
+            emit_word(shard, carry->word, carry->len);
+        carry->len = 0;
+    } else
+        tokenize(shard, carry, value, record->len);
+}
+
+static void *shard_main(void *arg) {
+    struct WordShard *shard = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&shard->lock);
+        while (shard->count == 0 && !shard->closed)
+            pthread_cond_wait(&shard->changed, &shard->lock);
+        if (shard->count == 0) {
+            pthread_mutex_unlock(&shard->lock);
+            break;
+        }
+        struct WordJob *job = shard->queue[shard->head];
+        shard->head = (shard->head + 1) % WORD_QUEUE;
+        shard->count--;
+        pthread_cond_broadcast(&shard->changed);
+        pthread_mutex_unlock(&shard->lock);
+
+        for (size_t off = 0; off < job->used; ) {
+            struct WordRecord record;
+            memcpy(&record, job->data + off, sizeof(record));
+            off += sizeof(record);
+            shard_item(shard, &record, job->data + off);
+            off += record.len;
+        }
+        free(job);
+    }
+    return NULL;
+}
+
+// hand the job being filled to the shard thread (waiting if its queue is full)
+static void shard_push(struct WordShard *shard) {
+    if (shard->filling == NULL)
+        return;
+
+    pthread_mutex_lock(&shard->lock);
+    while (shard->count == WORD_QUEUE)
+        pthread_cond_wait(&shard->changed, &shard->lock);
+    shard->queue[(shard->head + shard->count) % WORD_QUEUE] = shard->filling;
+    shard->count++;
+    pthread_cond_broadcast(&shard->changed);
+    pthread_mutex_unlock(&shard->lock);
+    shard->filling = NULL;
+}
+
+// copy an Item (or a piece of it) in the job of the shard
+static void shard_enqueue(struct WordShard *shard, const struct WordRecord *record,
+                          const char *value) {
+    size_t size = sizeof(*record) + record->len;
+    if (shard->filling != NULL && shard->filling->used + size > WORD_JOB_BYTES)
+        shard_push(shard);
+    if (shard->filling == NULL) {
+        shard->filling = malloc(sizeof(struct WordJob));
+        if (shard->filling == NULL)
+            errExit("malloc failed");
+        shard->filling->used = 0;
+    }
+
+    struct WordJob *job = shard->filling;
+    memcpy(job->data + job->used, record, sizeof(*record));
+    memcpy(job->data + job->used + sizeof(*record), value, record->len);
+    job->used += size;
+}
+
+void counter_init(struct WordCounter *counter, int nShards, int nFiles) {
+    counter->nShards = nShards;
+    counter->nFiles = nFiles;
+    counter->bytes = 0;
+    counter->carries = calloc(nFiles, sizeof(struct WordCarry));
+    counter->shards = calloc(nShards, sizeof(struct WordShard));
+    if (counter->carries == NULL || counter->shards == NULL)
+        errExit("calloc failed");
+
+    for (int i = 0; i < nShards; ++i) {
+        struct WordShard *shard = &counter->shards[i];
+        table_init(&shard->table);
+        shard->carries = counter->carries;
+        if (nShards == 1)
+            continue;
+
+        // more shards: each one is a thread, so the files are tokenized in parallel
+        pthread_mutex_init(&shard->lock, NULL);
+        pthread_cond_init(&shard->changed, NULL);
+        if (pthread_create(&shard->thread, NULL, shard_main, shard) != 0)
+            errExit("pthread_create failed");
+    }
+}
+
+int counter_item(struct WordCounter *counter, const struct ItemHeader *header,
+                 const char *value, size_t size) {
+    if (header->fileId >= (uint32_t) counter->nFiles)
+        return -1;
+
+    // all the Items of a file go to the same shard, in order
+    struct WordShard *shard = &counter->shards[header->fileId % counter->nShards];
+    struct WordRecord record = {.fileId = header->fileId, .flags = header->flags, .len = 0};
+    counter->bytes += size;
+
+    if (counter->nShards == 1) {
+        record.len = (uint32_t) size;
+        shard_item(shard, &record, value);
+        return 0;
+    }
+
+    // a big Item is split: its pieces stay in order
+    size_t maxPiece = WORD_JOB_BYTES - sizeof(record);
+    size_t off = 0;
+    do {
+        record.len = (uint32_t) ((size - off < maxPiece)? size - off : maxPiece);
+        record.flags = (off + record.len == size)? header->flags : 0;
+        shard_enqueue(shard, &record, value + off);
+        off += record.len;
+    } while (off < size);
+    return 0;
+}
+
+// the order of the report: more frequent first, then alphabetical
+static int word_before(const struct WordTable *table, const struct WordSlot *a,
+                       const struct WordSlot *b) {
+    if (a->count != b->count)
+        return a->count > b->count;
+    uint32_t len = (a->len < b->len)? a->len : b->len;
+    int res = memcmp(table->arena + a->offset, table->arena + b->offset, len);
+    return (res != 0)? res < 0 : a->len < b->len;
+}
+
+// restore the heap below position i (the root is the last word of the top-k)
+static void heap_down(const struct WordTable *table, const struct WordSlot **heap,
+                      int size, int i) {
+    for (;;) {
+        int worst = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < size && word_before(table, heap[worst], heap[l]))
+            worst = l;
+        if (r < size && word_before(table, heap[worst], heap[r]))
+            worst = r;
+        if (worst == i)
+            return;
+        const struct WordSlot *tmp = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = tmp;
+        i = worst;
+    }
+}
+
+static void heap_up(const struct WordTable *table, const struct WordSlot **heap, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!word_before(table, heap[parent], heap[i]))
+            return;
+        const struct WordSlot *tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+void counter_finish(struct WordCounter *counter, int k, double elapsed) {
+    // the shards tokenize their last jobs
+    if (counter->nShards > 1)
+        for (int i = 0; i < counter->nShards; ++i) {
+            struct WordShard *shard = &counter->shards[i];
+            shard_push(shard);
+            pthread_mutex_lock(&shard->lock);
+            shard->closed = 1;
+            pthread_cond_broadcast(&shard->changed);
+            pthread_mutex_unlock(&shard->lock);
+            if (pthread_join(shard->thread, NULL) != 0)
+                errExit("pthread_join failed");
+        }
+
+    // merge the tables of the shards in the first one
+    struct WordTable *table = &counter->shards[0].table;
+    unsigned long long tokens = counter->shards[0].tokens;
+    for (int i = 1; i < counter->nShards; ++i) {
+        struct WordTable *other = &counter->shards[i].table;
+        for (size_t j = 0; j < other->capacity; ++j) {
+            struct WordSlot *slot = &other->slots[j];
+            if (slot->hash != 0)
+                table_add(table, other->arena + slot->offset, slot->len, slot->hash, slot->count);
+        }
+        tokens += counter->shards[i].tokens;
+        table_free(other);
+    }
+
+    // keep the k most frequent words in a heap, whose root is the least frequent
+    if (k > (int) table->used)
+        k = (int) table->used;
+    const struct WordSlot **heap = malloc((k + 1) * sizeof(struct WordSlot *));
+    if (heap == NULL)
+        errExit("malloc failed");
+    int size = 0;
+    for (size_t j = 0; j < table->capacity && k > 0; ++j) {
+        const struct WordSlot *slot = &table->slots[j];
+        if (slot->hash == 0)
+            continue;
+        if (size < k) {
+            heap[size] = slot;
+            heap_up(table, heap, size++);
+        } else if (word_before(table, slot, heap[0])) {
+            heap[0] = slot;
+            heap_down(table, heap, size, 0);
+        }
+    }
+
+    // pop the heap: the words come out from the least frequent
+    for (int n = size; n > 1; --n) {
+        const struct WordSlot *tmp = heap[0];
+        heap[0] = heap[n - 1];
+        heap[n - 1] = tmp;
+        heap_down(table, heap, n - 1, 0);
+    }
+
+    printf("<Consumer> top %d words:\n", size);
+    for (int i = 0; i < size; ++i)
+        printf("<Consumer> %10llu %.*s\n", (unsigned long long) heap[i]->count,
+               (int) heap[i]->len, table->arena + heap[i]->offset);
+    printf("<Consumer> %llu tokens, %zu distinct words, %llu bytes in %.3f s "
+           "(%.2f Mtokens/s, %s classifier, %d shards)\n",
+           tokens, table->used, counter->bytes, elapsed,
+           (elapsed > 0)? tokens / elapsed / 1e6 : 0, word_kernel(), counter->nShards);
+
+    free(heap);
+    table_free(table);
+    free(counter->shards);
+    free(counter->carries);
+}
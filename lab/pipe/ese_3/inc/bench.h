@@ -0,0 +1,34 @@
+#ifndef _BENCH_HH
+#define _BENCH_HH
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "transport.h"
+
+// the BenchConfig structure collects the benchmark's command line options
+struct BenchConfig {
+    int times;              /* number of measured round trips           */
+    int warmup;             /* round trips executed before measuring    */
+    size_t payload;         /* bytes of a ping/pong message             */
+    int parentCPU;          /* CPU of the parent process (-1: no pin)   */
+    int childCPU;           /* CPU of the child process (-1: no pin)    */
+    const char *csvPath;    /* CSV file of the histogram (NULL: none)   */
+};
+
+// The now_ns method returns the time of a monotonic clock in nanoseconds
+uint64_t now_ns(void);
+
+// The pin_cpu method binds the calling process to a CPU (nothing if cpu is -1).
+// It terminates the calling process if the CPU can not be set
+void pin_cpu(int cpu);
+
+// The bench_child method answers to warmup + times pings with a pong of the same size
+void bench_child(struct Endpoint *endpoint, const struct BenchConfig *config);
+
+// The bench_parent method sends warmup + times pings and measures the round trip
+// time of the last times ones. At the end it prints the latency percentiles,
+// and writes the histogram as CSV if config->csvPath is set
+void bench_parent(struct Endpoint *endpoint, const struct BenchConfig *config);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef _TRANSPORT_HH
+#define _TRANSPORT_HH
+
+#include <stddef.h>
+#include <stdint.h>
+
+// size of a cache line: the fields written by the two processes are kept
+// in different cache lines, so they do not bounce between the two cores
+#define CACHE_LINE 64
+
+// default number of spins before a receiver sleeps on the futex
+#define SPIN_BUDGET 2000
+
+// the transports that can be selected from the command line:
+// TRANSPORT_PIPE exchanges the messages through two pipes,
+// TRANSPORT_SHM through two mailboxes in a shared mapping
+enum TransportKind {
+    TRANSPORT_PIPE,
+    TRANSPORT_SHM
+};
+
+// A Mailbox carries the messages of one direction in shared memory.
+// 'state' is 0 if the mailbox is empty, 1 if it holds a message: it is also
+// the futex word a process sleeps on. 'sleepers' tells the other process that
+// a wake up is needed. The message follows the control cache line
+struct Mailbox {
+    _Alignas(CACHE_LINE) uint32_t state;
+    uint32_t sleepers;
+    uint32_t size;
+    _Alignas(CACHE_LINE) char data[];
+};
+
+// A Transport is created before fork(), so that both processes inherit it
+struct Transport {
+    enum TransportKind kind;
+    size_t payload;                 /* max bytes of a message              */
+    int spin;                       /* spins before sleeping (shm)         */
+    int parent2child[2];            /* pipe parent --> child (pipe)        */
+    int child2parent[2];            /* pipe child --> parent (pipe)        */
+    void *mapping;                  /* the shared mapping (shm)            */
+    size_t mappingSize;
+    struct Mailbox *toChild;        /* mailbox parent --> child (shm)      */
+    struct Mailbox *toParent;       /* mailbox child --> parent (shm)      */
+};
+
+// An Endpoint is the side of a Transport used by one of the two processes
+struct Endpoint {
+    enum TransportKind kind;
+    int spin;
+    int readFD, writeFD;            /* pipe                                */
+    struct Mailbox *in, *out;       /* shm                                 */
+};
+
+// The parse_transport method converts "pipe" or "shm" into a TransportKind.
+// It returns -1 if name is not a known transport
+int parse_transport(const char *name, enum TransportKind *kind);
+
+// The transport_open method creates the pipes, or the shared mapping,
+// for messages of at most payload bytes.
+// It terminates the calling process if the transport can not be created
+void transport_open(struct Transport *transport, enum TransportKind kind,
+                    size_t payload, int spin);
+
+// The transport_pipe_size method sets the capacity of both pipes to at least
+// bytes bytes (only for TRANSPORT_PIPE).
+// It returns 0 on success, -1 if the kernel refuses the capacity
+int transport_pipe_size(struct Transport *transport, size_t bytes);
+
+// The transport_endpoint method gets the endpoint of the parent (isChild = 0)
+// or of the child (isChild = 1) process, closing the pipe ends it does not use.
+// It terminates the calling process if a close fails
+void transport_endpoint(struct Transport *transport, int isChild, struct Endpoint *endpoint);
+
+// The endpoint_send method sends a message of n bytes.
+// It returns 0 on success, -1 on error
+int endpoint_send(struct Endpoint *endpoint, const void *buffer, size_t n);
+
+// The endpoint_recv method receives a message of n bytes.
+// It returns 0 on success, -1 on error or end-of-file
+int endpoint_recv(struct Endpoint *endpoint, void *buffer, size_t n);
+
+// The endpoint_close method closes the pipe ends, or unmaps the shared mapping.
+// It terminates the calling process if a close fails
+void endpoint_close(struct Endpoint *endpoint, struct Transport *transport);
+
+#endif
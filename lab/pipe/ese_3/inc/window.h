@@ -0,0 +1,35 @@
+#ifndef _WINDOW_HH
+#define _WINDOW_HH
+
+#include <stdint.h>
+
+#include "bench.h"
+#include "transport.h"
+
+// max number of window sizes in a sweep
+#define MAX_WINDOWS 32
+
+// the header of a message in windowed mode: the child answers with the same seq
+struct WindowHeader {
+    uint64_t seq;
+};
+
+// The parse_windows method converts a list like "1,2,4,8" into window sizes.
+// It returns the number of windows, -1 if the list is not valid
+int parse_windows(const char *list, int *windows);
+
+// The window_message_size method returns the size of a message in windowed mode
+// (the payload, but at least a WindowHeader)
+size_t window_message_size(const struct BenchConfig *config);
+
+// The window_child method answers in order to each ping with a pong carrying
+// the same sequence number, until the parent closes its end of the transport
+void window_child(struct Endpoint *endpoint, const struct BenchConfig *config);
+
+// The window_parent method runs, for each window size K, warmup + times
+// exchanges keeping up to K pings in flight. It prints messages/s and the
+// per-message latency of each K, and writes them as CSV if config->csvPath is set
+void window_parent(struct Endpoint *endpoint, const struct BenchConfig *config,
+                   const int *windows, int nWindows);
+
+#endif
@@ -0,0 +1,100 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "histogram.h"
+#include "errExit.h"
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void pin_cpu(int cpu) {
+    if (cpu < 0)
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1)
+        errExit("sched_setaffinity failed");
+}
+
+void bench_child(struct Endpoint *endpoint, const struct BenchConfig *config) {
+    pin_cpu(config->childCPU);
+
+    char *buffer = malloc(config->payload);
+    if (buffer == NULL)
+        errExit("malloc failed");
+
+    int total = config->warmup + config->times;
+    for (int i = 0; i < total; i++) {
+        // read 'ping' from the parent process and send it back as 'pong'
+        if (endpoint_recv(endpoint, buffer, config->payload) == -1)
+            errExit("Reading child Failed");
+        if (endpoint_send(endpoint, buffer, config->payload) == -1)
+            errExit("Writing child Failed");
+    }
+
+    free(buffer);
+}
+
+void bench_parent(struct Endpoint *endpoint, const struct BenchConfig *config) {
+    pin_cpu(config->parentCPU);
+
+    char *ping = malloc(config->payload);
+    char *pong = malloc(config->payload);
+    struct Histogram *hist = malloc(sizeof(struct Histogram));
+    if (ping == NULL || pong == NULL || hist == NULL)
+        errExit("malloc failed");
+
+    memset(ping, 'p', config->payload);
+    hist_init(hist);
+
+    int total = config->warmup + config->times;
+    uint64_t begin = 0;
+    for (int i = 0; i < total; i++) {
+        if (i == config->warmup)
+            begin = now_ns();
+
+        uint64_t start = now_ns();
+        if (endpoint_send(endpoint, ping, config->payload) == -1)
+            errExit("Writing Parent Failed");
+        if (endpoint_recv(endpoint, pong, config->payload) == -1)
+            errExit("Reading Parent Failed");
+        uint64_t end = now_ns();
+
+        // the warm-up round trips are not measured
+        if (i >= config->warmup)
+            hist_record(hist, end - start);
+    }
+    uint64_t elapsed = now_ns() - begin;
+
+    printf("<Bench> %s: %d round trips (%d warm-up), payload %zu bytes\n",
+           (endpoint->kind == TRANSPORT_SHM)? "shm" : "pipe",
+           config->times, config->warmup, config->payload);
+    hist_print(hist, stdout);
+    if (elapsed > 0)
+        printf("<Bench> %.0f round trips/s\n", config->times * 1e9 / elapsed);
+
+    if (config->csvPath != NULL) {
+        FILE *csv = fopen(config->csvPath, "w");
+        if (csv == NULL)
+            errExit("fopen csv failed");
+        hist_csv(hist, csv);
+        if (fclose(csv) == EOF)
+            errExit("fclose csv failed");
+        printf("<Bench> histogram written to %s\n", config->csvPath);
+    }
+
+    free(ping);
+    free(pong);
+    free(hist);
+}
@@ -6,36 +6,102 @@
 #include <unistd.h>
 
 #include "errExit.h"
+#include "bench.h"
+#include "transport.h"
+#include "window.h"
+
+static void usage (const char *prog) {
+    printf("Usage: %s [-t pipe|shm] [-S spins] [-b] [-w warmup] [-s payloadBytes] [-p parentCPU] [-c childCPU] [-o csvFile] [-k K1,K2,...] times\n", prog);
+    printf("  -t  transport: two pipes (default), or shared memory mailboxes + futex\n");
+    printf("  -S  spins before sleeping on the futex (with -t shm)\n");
+    printf("  -b  benchmark mode: measure the round trip latency instead of printing\n");
+    printf("  -w  round trips executed before measuring (with -b)\n");
+    printf("  -s  bytes of a ping/pong message (with -b)\n");
+    printf("  -p  pin the parent process to a CPU (with -b)\n");
+    printf("  -c  pin the child process to a CPU (with -b)\n");
+    printf("  -o  write the latency histogram as CSV (with -b), or the sweep (with -k)\n");
+    printf("  -k  windowed mode: keep up to K pings in flight, for each K of the list (with -t pipe)\n");
+}
 
 int main (int argc, char *argv[]) {
     
     // Check command line input arguments.
-    // The program only wants a text file
-    if (argc != 2) {
-        printf("Usage: %s times\n", argv[0]);
-        return 0;
+    // The program wants the number of ping/pong exchanges
+    struct BenchConfig config = {
+        .warmup = 1000, .payload = 4, .parentCPU = -1, .childCPU = -1, .csvPath = NULL
+    };
+    enum TransportKind kind = TRANSPORT_PIPE;
+    // spinning is useful only if the other process runs on another CPU
+    int spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1)? SPIN_BUDGET : 0;
+    int windows[MAX_WINDOWS];
+    int nWindows = 0;
+    int bench = 0, opt;
+    while ((opt = getopt(argc, argv, "t:S:bw:s:p:c:o:k:")) != -1) {
+        switch (opt) {
+            case 't':
+                if (parse_transport(optarg, &kind) == -1) {
+                    usage(argv[0]);
+                    return 0;
+                }
+                break;
+            case 'S': spin = atoi(optarg); break;
+            case 'b': bench = 1; break;
+            case 'w': config.warmup = atoi(optarg); break;
+            case 's': config.payload = strtoul(optarg, NULL, 10); break;
+            case 'p': config.parentCPU = atoi(optarg); break;
+            case 'c': config.childCPU = atoi(optarg); break;
+            case 'o': config.csvPath = optarg; break;
+            case 'k':
+                if ((nWindows = parse_windows(optarg, windows)) == -1) {
+                    usage(argv[0]);
+                    return 0;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 0;
+        }
     }
 
-    int times = atoi(argv[1]);
-    if (times == 0)
+    if (argc - optind != 1 || config.warmup < 0 || config.payload == 0 || spin < 0) {
+        usage(argv[0]);
         return 0;
+    }
 
-    // a pipe is a unirectional bytes stream. If two process have to exchange
-    // data through pipe, then two pipes are needed.
-
-    // the first pipe lets the parent process send data to the child process
-    int pipe_parent2child[2];
-    // the second pipe lets the child process send data to the parent process
-    int pipe_child2parent[2];
+    int times = atoi(argv[optind]);
+    if (times <= 0)
+        return 0;
+    config.times = times;
 
-    // Make new PIPEs
-    if(pipe(pipe_parent2child) == -1)
-	    errExit("PAR2CHILD Failed");
+    // a shm mailbox holds one message: only pipes can keep many messages in flight
+    if (nWindows > 0 && kind != TRANSPORT_PIPE) {
+        printf("The windowed mode (-k) needs the pipe transport\n");
+        return 0;
+    }
 
-    if(pipe(pipe_child2parent) == -1)
-	    errExit("CHILD2PARENT Failed");
+    // the transport is created before fork(), so that the child inherits it.
+    // The ping/pong messages need payload bytes in bench mode, 4 otherwise
+    struct Transport transport;
+    transport_open(&transport, kind, bench? config.payload : 4, spin);
+
+    // in windowed mode the parent writes up to K pings before reading a pong:
+    // the pipes must hold a whole window, otherwise both processes could block
+    // on a full pipe
+    if (nWindows > 0) {
+        int maxWindow = 0;
+        for (int i = 0; i < nWindows; ++i)
+            if (windows[i] > maxWindow)
+                maxWindow = windows[i];
+        size_t windowBytes = maxWindow * window_message_size(&config);
+        if (windowBytes > (size_t) sysconf(_SC_PAGESIZE) * 16 &&
+            transport_pipe_size(&transport, windowBytes) == -1) {
+            printf("A window of %zu bytes does not fit in a pipe\n", windowBytes);
+            return 0;
+        }
+    }
 
-    ssize_t rB, wB = -1;
+    struct Endpoint endpoint;
+    int rB, wB = -1;
     char buffer [5];
 
     switch (fork()) {
@@ -43,74 +109,64 @@ int main (int argc, char *argv[]) {
             errExit("fork failed");
         case 0: {
 	        // child process
-            // close the write end of the pipe parent2child,
-            // and the read end of the pipe child2parent
-            if(close(pipe_parent2child[1]) == -1)
-		        errExit("PAR2CHILD w close Failed");
+            transport_endpoint(&transport, 1, &endpoint);
 
-	        if(close(pipe_child2parent[0]) == -1)
-		        errExit("CHILD2PARENT r close Failed");
+            if (nWindows > 0)
+                window_child(&endpoint, &config);
+            else if (bench)
+                bench_child(&endpoint, &config);
 
             char *pongText = "pong";
             ssize_t textSize = strlen(pongText);
-            for (int i = 0; i < times; i++) {
+            for (int i = 0; i < times && !bench && nWindows == 0; i++) {
                 // read 'ping' from the parent process
 		        // if parent does not write ping, the child process sleeps 
-                rB = read(pipe_parent2child[0], buffer, textSize);
-		        if(rB == -1 || rB < textSize)
+                rB = endpoint_recv(&endpoint, buffer, textSize);
+		        if(rB == -1)
 			        errExit("Reading child Failed");
-		        buffer[rB] = '\0';
+		        buffer[textSize] = '\0';
                 printf("%d - %s\n", (i + 1), buffer);
 
                 // write 'pong' to the parent process
-                wB = write(pipe_child2parent[1], pongText, textSize);
+                wB = endpoint_send(&endpoint, pongText, textSize);
 		        if(wB == -1)
                     errExit("Writing child Failed");
             }
 
-            // close the read end of the pipe parent2child,
-            // and the write end of the pipe child2paremt
-            if(close(pipe_parent2child[0]) == -1)
-                errExit("PAR2CHILD r close Failed");
-
-            if(close(pipe_child2parent[1]) == -1)
-                errExit("CHILD2PARENT w close Failed");
+            // close the child's side of the transport
+            endpoint_close(&endpoint, &transport);
 
             _exit(0);
         }
         default: {
-            // close the read end of the pipe parent2child,
-            // and the write end of the pipe child2parent
-            if(close(pipe_parent2child[0]) == -1)
-                errExit("PAR2CHILD r close Failed");
+            // parent process
+            transport_endpoint(&transport, 0, &endpoint);
 
-            if(close(pipe_child2parent[1]) == -1)
-                errExit("CHILD2PARENT w close Failed");
+            if (nWindows > 0)
+                window_parent(&endpoint, &config, windows, nWindows);
+            else if (bench)
+                bench_parent(&endpoint, &config);
 
             char *pingText = "ping";
             ssize_t textSize = strlen(pingText);
-            for (int i = 0; i < times; i++) {
+            for (int i = 0; i < times && !bench && nWindows == 0; i++) {
                 // write 'ping' to the child process
-                wB = write(pipe_parent2child[1], pingText, textSize);
+                wB = endpoint_send(&endpoint, pingText, textSize);
                 if(wB == -1)
                     errExit("Writing Parent Failed");
 
-                        // read 'pong' from the parent process
-                        rB = read(pipe_child2parent[0], buffer, textSize);
-                if(rB == -1 || rB < textSize)
+                // read 'pong' from the child process
+                rB = endpoint_recv(&endpoint, buffer, textSize);
+                if(rB == -1)
                     errExit("Reading Parent Failed");
-                buffer[rB] = '\0';
+                buffer[textSize] = '\0';
 
                 printf("%d - %s\n", (i + 1), buffer);
             }
 
-            // close the write end of the pipe parent2child,
-            // and the read end of the pipe child2paremt
-            if(close(pipe_parent2child[1]) == -1)
-                errExit("PAR2CHILD w close Failed");
-
-            if(close(pipe_child2parent[0]) == -1)
-                errExit("CHILD2PARENT r close Failed");
+            // close the parent's side of the transport
+            // (in windowed mode the child sees end-of-file and terminates)
+            endpoint_close(&endpoint, &transport);
         }
     }
     
@@ -0,0 +1,201 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "transport.h"
+#include "errExit.h"
+
+int parse_transport(const char *name, enum TransportKind *kind) {
+    if (strcmp(name, "pipe") == 0)
+        *kind = TRANSPORT_PIPE;
+    else if (strcmp(name, "shm") == 0)
+        *kind = TRANSPORT_SHM;
+    else
+        return -1;
+    return 0;
+}
+
+// tell the CPU that we are spinning (it saves power, and the sibling
+// hyper-thread gets the execution units)
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+// the mapping is shared between two processes: the futex can not be private
+static void futex_wait(uint32_t *word, uint32_t value) {
+    syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// wait until the state of the mailbox is want: spin for at most spin
+// iterations, then sleep on the futex
+static void mailbox_wait(struct Mailbox *mailbox, uint32_t want, int spin) {
+    for (int i = 0; i < spin; ++i) {
+        if (__atomic_load_n(&mailbox->state, __ATOMIC_ACQUIRE) == want)
+            return;
+        cpu_relax();
+    }
+
+    uint32_t state;
+    while ((state = __atomic_load_n(&mailbox->state, __ATOMIC_ACQUIRE)) != want) {
+        // announce the sleeper before checking the state again:
+        // a state change after this point is followed by a wake up
+        __atomic_add_fetch(&mailbox->sleepers, 1, __ATOMIC_SEQ_CST);
+        state = __atomic_load_n(&mailbox->state, __ATOMIC_SEQ_CST);
+        if (state != want)
+            futex_wait(&mailbox->state, state);
+        __atomic_sub_fetch(&mailbox->sleepers, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+// set the state of the mailbox, and wake up the other process if it sleeps
+static void mailbox_set(struct Mailbox *mailbox, uint32_t state) {
+    __atomic_store_n(&mailbox->state, state, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&mailbox->sleepers, __ATOMIC_SEQ_CST) != 0)
+        futex_wake(&mailbox->state);
+}
+
+void transport_open(struct Transport *transport, enum TransportKind kind,
+                    size_t payload, int spin) {
+    memset(transport, 0, sizeof(*transport));
+    transport->kind = kind;
+    transport->payload = payload;
+    transport->spin = spin;
+
+    if (kind == TRANSPORT_PIPE) {
+        // a pipe is a unirectional bytes stream. If two process have to exchange
+        // data through pipe, then two pipes are needed.
+        if (pipe(transport->parent2child) == -1)
+            errExit("PAR2CHILD Failed");
+        if (pipe(transport->child2parent) == -1)
+            errExit("CHILD2PARENT Failed");
+        return;
+    }
+
+    // a mailbox for each direction, each one starting on its own cache line
+    size_t dataSize = (payload + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    size_t mailboxSize = sizeof(struct Mailbox) + dataSize;
+
+    // the anonymous shared mapping is inherited by the child after fork()
+    transport->mappingSize = 2 * mailboxSize;
+    transport->mapping = mmap(NULL, transport->mappingSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (transport->mapping == MAP_FAILED)
+        errExit("mmap failed");
+
+    transport->toChild = (struct Mailbox *) transport->mapping;
+    transport->toParent = (struct Mailbox *) ((char *) transport->mapping + mailboxSize);
+}
+
+int transport_pipe_size(struct Transport *transport, size_t bytes) {
+    if (transport->kind != TRANSPORT_PIPE)
+        return -1;
+
+    // the kernel rounds the capacity up to a power of two pages
+    if (fcntl(transport->parent2child[1], F_SETPIPE_SZ, (int) bytes) == -1 ||
+        fcntl(transport->child2parent[1], F_SETPIPE_SZ, (int) bytes) == -1)
+        return -1;
+    return 0;
+}
+
+void transport_endpoint(struct Transport *transport, int isChild, struct Endpoint *endpoint) {
+    endpoint->kind = transport->kind;
+    endpoint->spin = transport->spin;
+
+    if (transport->kind == TRANSPORT_SHM) {
+        endpoint->in = isChild? transport->toChild : transport->toParent;
+        endpoint->out = isChild? transport->toParent : transport->toChild;
+        return;
+    }
+
+    if (isChild) {
+        // close the write end of the pipe parent2child,
+        // and the read end of the pipe child2parent
+        if (close(transport->parent2child[1]) == -1)
+            errExit("PAR2CHILD w close Failed");
+        if (close(transport->child2parent[0]) == -1)
+            errExit("CHILD2PARENT r close Failed");
+        endpoint->readFD = transport->parent2child[0];
+        endpoint->writeFD = transport->child2parent[1];
+    } else {
+        // close the read end of the pipe parent2child,
+        // and the write end of the pipe child2parent
+        if (close(transport->parent2child[0]) == -1)
+            errExit("PAR2CHILD r close Failed");
+        if (close(transport->child2parent[1]) == -1)
+            errExit("CHILD2PARENT w close Failed");
+        endpoint->readFD = transport->child2parent[0];
+        endpoint->writeFD = transport->parent2child[1];
+    }
+}
+
+int endpoint_send(struct Endpoint *endpoint, const void *buffer, size_t n) {
+    if (endpoint->kind == TRANSPORT_PIPE) {
+        // a message bigger than PIPE_BUF may be sent with more writes
+        for (size_t off = 0; off < n; ) {
+            ssize_t wB = write(endpoint->writeFD, (const char *) buffer + off, n - off);
+            if (wB == -1 && errno == EINTR)
+                continue;
+            if (wB == -1)
+                return -1;
+            off += wB;
+        }
+        return 0;
+    }
+
+    // wait until the other process took the previous message
+    mailbox_wait(endpoint->out, 0, endpoint->spin);
+    memcpy(endpoint->out->data, buffer, n);
+    endpoint->out->size = n;
+    mailbox_set(endpoint->out, 1);
+    return 0;
+}
+
+int endpoint_recv(struct Endpoint *endpoint, void *buffer, size_t n) {
+    if (endpoint->kind == TRANSPORT_PIPE) {
+        // a message bigger than PIPE_BUF may be received with more reads
+        for (size_t off = 0; off < n; ) {
+            ssize_t rB = read(endpoint->readFD, (char *) buffer + off, n - off);
+            if (rB == -1 && errno == EINTR)
+                continue;
+            if (rB <= 0)
+                return -1;
+            off += rB;
+        }
+        return 0;
+    }
+
+    mailbox_wait(endpoint->in, 1, endpoint->spin);
+    if (endpoint->in->size != n)
+        return -1;
+    memcpy(buffer, endpoint->in->data, n);
+    mailbox_set(endpoint->in, 0);
+    return 0;
+}
+
+void endpoint_close(struct Endpoint *endpoint, struct Transport *transport) {
+    if (endpoint->kind == TRANSPORT_SHM) {
+        if (munmap(transport->mapping, transport->mappingSize) == -1)
+            errExit("munmap failed");
+        return;
+    }
+
+    if (close(endpoint->readFD) == -1)
+        errExit("pipe r close Failed");
+    if (close(endpoint->writeFD) == -1)
+        errExit("pipe w close Failed");
+}
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "window.h"
+#include "histogram.h"
+#include "errExit.h"
+
+int parse_windows(const char *list, int *windows) {
+    int n = 0;
+    const char *p = list;
+    while (*p != '\0') {
+        char *end;
+        long k = strtol(p, &end, 10);
+        if (end == p || k <= 0 || n == MAX_WINDOWS)
+            return -1;
+        windows[n++] = (int) k;
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        p = end;
+    }
+    return (n > 0)? n : -1;
+}
+
+size_t window_message_size(const struct BenchConfig *config) {
+    return (config->payload < sizeof(struct WindowHeader))?
+        sizeof(struct WindowHeader) : config->payload;
+}
+
+void window_child(struct Endpoint *endpoint, const struct BenchConfig *config) {
+    pin_cpu(config->childCPU);
+
+    size_t size = window_message_size(config);
+    char *buffer = malloc(size);
+    if (buffer == NULL)
+        errExit("malloc failed");
+
+    // the pings arrive in order: each pong is the ping sent back,
+    // so it carries the same sequence number
+    while (endpoint_recv(endpoint, buffer, size) == 0)
+        if (endpoint_send(endpoint, buffer, size) == -1)
+            errExit("Writing child Failed");
+
+    free(buffer);
+}
+
+// run warmup + times exchanges with up to window pings in flight
+static void run_window(struct Endpoint *endpoint, const struct BenchConfig *config,
+                       int window, struct Histogram *hist, double *msgsPerSec) {
+    size_t size = window_message_size(config);
+    char *ping = malloc(size);
+    char *pong = malloc(size);
+    // send time of each message in flight, indexed by seq % window
+    uint64_t *sentAt = malloc(window * sizeof(uint64_t));
+    if (ping == NULL || pong == NULL || sentAt == NULL)
+        errExit("malloc failed");
+
+    memset(ping, 'p', size);
+    hist_init(hist);
+
+    uint64_t total = config->warmup + config->times;
+    uint64_t sent = 0, received = 0, begin = 0;
+    while (received < total) {
+        // fill the window
+        while (sent < total && sent - received < (uint64_t) window) {
+            struct WindowHeader header = {.seq = sent};
+            memcpy(ping, &header, sizeof(header));
+            sentAt[sent % window] = now_ns();
+            if (endpoint_send(endpoint, ping, size) == -1)
+                errExit("Writing Parent Failed");
+            sent++;
+        }
+
+        // wait for the oldest message in flight
+        if (endpoint_recv(endpoint, pong, size) == -1)
+            errExit("Reading Parent Failed");
+        uint64_t now = now_ns();
+
+        struct WindowHeader header;
+        memcpy(&header, pong, sizeof(header));
+        if (header.seq != received) {
+            fprintf(stderr, "<Window> expected seq %llu, received %llu\n",
+                    (unsigned long long) received, (unsigned long long) header.seq);
+            exit(1);
+        }
+
+        // the warm-up messages are not measured
+        if (received == (uint64_t) config->warmup)
+            begin = sentAt[received % window];
+        if (received >= (uint64_t) config->warmup)
+            hist_record(hist, now - sentAt[received % window]);
+        received++;
+    }
+    uint64_t elapsed = now_ns() - begin;
+    *msgsPerSec = (elapsed > 0)? config->times * 1e9 / elapsed : 0;
+
+    free(ping);
+    free(pong);
+    free(sentAt);
+}
+
+void window_parent(struct Endpoint *endpoint, const struct BenchConfig *config,
+                   const int *windows, int nWindows) {
+    pin_cpu(config->parentCPU);
+
+    struct Histogram *hist = malloc(sizeof(struct Histogram));
+    if (hist == NULL)
+        errExit("malloc failed");
+
+    FILE *csv = NULL;
+    if (config->csvPath != NULL) {
+        csv = fopen(config->csvPath, "w");
+        if (csv == NULL)
+            errExit("fopen csv failed");
+        fprintf(csv, "window,msgs_per_s,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+    }
+
+    printf("<Window> %d messages (%d warm-up) for each window, message %zu bytes\n",
+           config->times, config->warmup, window_message_size(config));
+    printf("<Window> %6s %14s %12s %12s %12s %12s\n",
+           "K", "msgs/s", "p50 us", "p99 us", "p99.9 us", "max us");
+
+    for (int i = 0; i < nWindows; ++i) {
+        double msgsPerSec;
+        run_window(endpoint, config, windows[i], hist, &msgsPerSec);
+
+        uint64_t p50 = hist_percentile(hist, 50), p90 = hist_percentile(hist, 90);
+        uint64_t p99 = hist_percentile(hist, 99), p999 = hist_percentile(hist, 99.9);
+        printf("<Window> %6d %14.0f %12.3f %12.3f %12.3f %12.3f\n", windows[i],
+               msgsPerSec, p50 / 1000.0, p99 / 1000.0, p999 / 1000.0, hist->max / 1000.0);
+
+        if (csv != NULL)
+            fprintf(csv, "%d,%.0f,%llu,%llu,%llu,%llu,%llu\n", windows[i], msgsPerSec,
+                    (unsigned long long) p50, (unsigned long long) p90,
+                    (unsigned long long) p99, (unsigned long long) p999,
+                    (unsigned long long) hist->max);
+    }
+
+    if (csv != NULL) {
+        if (fclose(csv) == EOF)
+            errExit("fclose csv failed");
+        printf("<Window> sweep written to %s\n", config->csvPath);
+    }
+
+    free(hist);
+}